@@ -0,0 +1,46 @@
+#ifndef analysis_control
+#define analysis_control
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+
+#define ANALYSIS_PHASES 6
+
+/* Phases of the analysis of a grammar in the order they run. DONE means
+ * every phase finished. */
+enum class AnalysisPhase {
+  SYMBOLS, NULLABLE, FIRST, FOLLOW, LL_CHECK, TABLE, DONE
+};
+
+enum class AnalysisStatus { DONE, CANCELLED, TIMED_OUT };
+
+/* Receives the phase that just finished, the phases done and ANALYSIS_PHASES */
+typedef std::function<void(AnalysisPhase, size_t, size_t)> ProgressCallback;
+
+/* Limits of a run of the analysis. It stops at the deadline or once the
+ * cancel flag is set, whichever comes first. Both are checked between phases
+ * and inside the loops of the long ones, so a run stops soon after. */
+struct AnalysisControl {
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::time_point::max();
+  const std::atomic<bool> *cancel = NULL; // Can be set from any thread
+  ProgressCallback progress;              // Called in the analyzing thread
+
+  AnalysisControl() {}
+
+  /* Stops the run after the time from now */
+  AnalysisControl(std::chrono::steady_clock::duration timeout) {
+    deadline = std::chrono::steady_clock::now() + timeout;
+  }
+
+  bool cancelled() const { return cancel != NULL && *cancel; }
+
+  bool stop() const {
+    return cancelled() || (deadline != std::chrono::steady_clock::time_point::
+      max() && std::chrono::steady_clock::now() >= deadline);
+  }
+};
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef batch_analysis
+#define batch_analysis
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <list>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "table_exporter.h"
+#include "thread_pool.h"
+
+#define BATCH_MAX_LINE_LEN 4096
+
+/* Analysis of many grammar files in one process, as one JSON document:
+ *   {"files": n, "threads": t, "ms": total, "results": [
+ *     {"file": path, "rules": n, "ll": bool, "regular": bool,
+ *      "variables": [{"name": var, "first": [...], "follow": [...]}],
+ *      "table": LL table or null, "tests": [bool, ...], "ms": time}
+ *   ]}
+ * A file that can not be analyzed has {"file": path, "error": reason}. Files
+ * use the input of ll_table ("<rules> [tests]" and then the lines), and the
+ * results keep the order of the files whatever the order they finish in. */
+
+typedef std::chrono::steady_clock BatchClock;
+
+inline double elapsedMs(BatchClock::time_point start) {
+  return std::chrono::duration<double, std::milli>(BatchClock::now() - start)
+    .count();
+}
+
+/* Reads a line without its "\n" or "\r\n". A line that does not fit in
+ * BATCH_MAX_LINE_LEN is read to its end and tooLong is set, so its tail is
+ * never taken as the next line. */
+inline bool readBatchLine(FILE *in, std::string &line,
+  bool &tooLong) {
+  char str[BATCH_MAX_LINE_LEN];
+  int c;
+
+  tooLong = false;
+  if (fgets(str, BATCH_MAX_LINE_LEN, in) == NULL) return false;
+  size_t len = strlen(str);
+  if (len > 0 && str[len-1] == '\n') str[--len] = '\0';
+  else if (len == BATCH_MAX_LINE_LEN - 1 && (c = fgetc(in)) != EOF &&
+      c != '\n') {
+    while ((c = fgetc(in)) != EOF && c != '\n');
+    tooLong = true;
+  }
+  if (len > 0 && str[len-1] == '\r') str[--len] = '\0';
+  line = std::string(str, len);
+  return true;
+}
+
+inline std::string jsonString(const std::string &str) {
+  std::string out = "\"";
+  for (const char c : str) {
+    if (c == '"' || c == '\\') { out.push_back('\\'); out.push_back(c); }
+    else if ((unsigned char)c < 0x20) {
+      char code[8];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      out.append(code);
+    } else out.push_back(c);
+  }
+  return out + "\"";
+}
+
+inline std::string jsonList(const std::list<std::string> &list) {
+  std::string out = "[";
+  for (const std::string &elem : list) {
+    if (out.size() > 1) out.append(", ");
+    out.append(jsonString(elem));
+  }
+  return out + "]";
+}
+
+/* Returns the JSON result of one grammar file */
+inline std::string analyzeGrammarFile(const std::string &path) {
+  BatchClock::time_point start = BatchClock::now();
+  std::string out = "{\"file\": " + jsonString(path), line;
+  std::list<std::string> rules, tests;
+  int nrules = 0, ntests = 0;
+  bool tooLong, anyTooLong = false;
+  char time[64];
+  FILE *in;
+
+  if ((in = fopen(path.c_str(), "r")) == NULL)
+    return out + ", \"error\": \"Could not open the file\"}";
+  if (!readBatchLine(in, line, tooLong) || tooLong ||
+      sscanf(line.c_str(), "%i %i", &nrules, &ntests) < 1) {
+    fclose(in);
+    return out + ", \"error\": \"Missing the number of rules\"}";
+  }
+  for (int i = 0; i < nrules && readBatchLine(in, line, tooLong); i++) {
+    anyTooLong |= tooLong;
+    rules.push_back(line);
+  }
+  for (int i = 0; i < ntests && readBatchLine(in, line, tooLong); i++) {
+    anyTooLong |= tooLong;
+    tests.push_back(line);
+  }
+  fclose(in);
+  if (anyTooLong)
+    return out + ", \"error\": \"Line longer than " +
+      std::to_string(BATCH_MAX_LINE_LEN - 1) + " bytes\"}";
+
+  // Files are analyzed in parallel, not the sets of each one
+  LexicalAnalyzer analyzer;
+  analyzer.setThreads(1);
+  try {
+    if (!analyzer.parse(rules))
+      return out + ", \"error\": \"Syntax for the rules was rejected\"}";
+  } catch (const std::exception &e) {
+    return out + ", \"error\": " + jsonString(e.what()) + "}";
+  }
+
+  out.append(", \"rules\": " + std::to_string(rules.size()));
+  out.append(", \"ll\": ");
+  out.append((analyzer.is_ll())? "true" : "false");
+  out.append(", \"regular\": ");
+  out.append((analyzer.is_regular())? "true" : "false");
+
+  out.append(", \"variables\": [");
+  bool first = true;
+  for (const std::string &var : analyzer.getVariables()) {
+    if (!first) out.append(", ");
+    out.append("{\"name\": " + jsonString(var));
+    out.append(", \"first\": " + jsonList(analyzer.getFirst(var)));
+    out.append(", \"follow\": " + jsonList(analyzer.getFollow(var)) + "}");
+    first = false;
+  }
+  out.append("], \"table\": ");
+  if (analyzer.is_ll()) {
+    BufferedWriter table(out);
+    TableExporter(TableFormat::JSON).write(analyzer, table);
+    table.flush();
+    out.pop_back(); // Pop last '\n'
+  } else {
+    out.append("null");
+  }
+
+  out.append(", \"tests\": [");
+  first = true;
+  for (const std::string &test : tests) {
+    if (!first) out.append(", ");
+    out.append((analyzer.validStr(test))? "true" : "false");
+    first = false;
+  }
+  snprintf(time, sizeof(time), "], \"ms\": %.3f}", elapsedMs(start));
+  return out + time;
+}
+
+/* Returns the regular files of a directory sorted by name, or the lines of
+ * a manifest if the path is a file. Empty lines of a manifest are skipped
+ * and a line too long for a path makes it fail. */
+inline bool listGrammarFiles(const std::string &path,
+  std::vector<std::string> &files) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) return false;
+
+  if (S_ISDIR(info.st_mode)) {
+    DIR *dir = opendir(path.c_str());
+    struct dirent *entry;
+    if (dir == NULL) return false;
+    while ((entry = readdir(dir)) != NULL) {
+      std::string file = path + "/" + entry->d_name;
+      if (stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+        files.push_back(file);
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    return true;
+  }
+
+  FILE *manifest = fopen(path.c_str(), "r");
+  std::string line;
+  bool tooLong, fits = true;
+  if (manifest == NULL) return false;
+  while (fits && readBatchLine(manifest, line, tooLong)) {
+    fits = !tooLong;
+    if (fits && !line.empty()) files.push_back(line);
+  }
+  fclose(manifest);
+  return fits;
+}
+
+/* Analyzes the files with at most nthreads threads and writes the document
+ * to out. Every task writes only its own result, so they are written in the
+ * order of the files. Returns the threads used. */
+inline size_t analyzeGrammarFiles(const std::vector<std::string> &files,
+  size_t nthreads, BufferedWriter &out) {
+  BatchClock::time_point start = BatchClock::now();
+  std::vector<std::string> results(files.size());
+  char header[128];
+
+  {
+    ThreadPool pool(std::min(nthreads, std::max(files.size(), (size_t)1)));
+    for (size_t i = 0; i < files.size(); i++)
+      pool.submit([&, i] { results[i] = analyzeGrammarFile(files[i]); });
+    pool.wait();
+    nthreads = pool.size();
+  }
+
+  snprintf(header, sizeof(header),
+    "{\"files\": %zu, \"threads\": %zu, \"ms\": %.3f, \"results\": [",
+    files.size(), nthreads, elapsedMs(start));
+  out.write(header);
+  for (size_t i = 0; i < results.size(); i++) {
+    out.write((i > 0)? ",\n  " : "\n  ");
+    out.write(results[i]);
+  }
+  out.write("\n]}\n");
+  return nthreads;
+}
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef chain_collapse
+#define chain_collapse
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "production_set.h"
+
+#define CHAIN_EPSILON "''"
+
+/* Productions of an original grammar that a production stands for, in the
+ * order a leftmost derivation applies them. slots has, by element of the
+ * right hand side, how many of them come before the subtree of the element,
+ * which is where the productions that expand it are inserted. */
+struct ProdOrigin {
+  std::vector<size_t> prods;
+  std::vector<size_t> slots;
+};
+
+/* A production built by ChainCollapse */
+struct ChainRule {
+  size_t head; // Variable id
+  std::vector<std::string> body;
+  ProdOrigin origin;
+};
+
+/* Shortens the derivations of a grammar without changing its language:
+ *   - A unit production A -> B is replaced by A -> w for every production
+ *     B -> w, following chains A -> B -> C ... and skipping cycles.
+ *   - A variable with one production that is used only once, by another
+ *     variable, is replaced by the right hand side of its production.
+ * Only the variables reached from the start symbol are kept. Every step of
+ * a chain that is gone was a pop, a table lookup and a push for the
+ * predictive parser, and it keeps being LL(1) if it was. */
+class ChainCollapse {
+  private:
+    const ProductionSet &prods;
+    const std::map<std::string, size_t> &varIds;
+    const std::vector<ProdOrigin> &origins;
+    size_t nvars, start;
+    std::vector<std::vector<ChainRule>> rules; // By variable
+    std::vector<size_t> visited; // Stamp of the last expansion of each one
+    size_t stamp;
+
+    /* Id of the variable of an element, or nvars for the rest */
+    size_t varOf(const std::string &elem) const {
+      std::map<std::string, size_t>::const_iterator it = varIds.find(elem);
+      return (it == varIds.end())? nvars : it->second;
+    }
+
+    bool isUnit(size_t p) const {
+      return prods.elements(p).size() == 1 &&
+        varOf(prods.elements(p)[0]) < nvars;
+    }
+
+    ChainRule base(size_t p) const {
+      Span<std::string> elements = prods.elements(p);
+      return ChainRule{varOf(prods.variable(p)),
+        std::vector<std::string>(elements.begin(), elements.end()),
+        origins[p]};
+    }
+
+    /* Replaces the element k of host, a variable, by the body of rule */
+    static ChainRule expand(const ChainRule &host, size_t k,
+      const ChainRule &rule) {
+      const size_t at = host.origin.slots[k], n = rule.origin.prods.size();
+      ChainRule r{host.head, {}, {}};
+
+      r.origin.prods.assign(host.origin.prods.begin(),
+        host.origin.prods.begin() + at);
+      r.origin.prods.insert(r.origin.prods.end(), rule.origin.prods.begin(),
+        rule.origin.prods.end());
+      r.origin.prods.insert(r.origin.prods.end(),
+        host.origin.prods.begin() + at, host.origin.prods.end());
+
+      for (size_t j = 0; j < k; j++) {
+        r.body.push_back(host.body[j]);
+        r.origin.slots.push_back(host.origin.slots[j]);
+      }
+      for (size_t i = 0; i < rule.body.size(); i++)
+        if (rule.body[i].compare(CHAIN_EPSILON) != 0) {
+          r.body.push_back(rule.body[i]);
+          r.origin.slots.push_back(at + rule.origin.slots[i]);
+        }
+      for (size_t j = k + 1; j < host.body.size(); j++) {
+        r.body.push_back(host.body[j]);
+        r.origin.slots.push_back(host.origin.slots[j] + n);
+      }
+      if (r.body.empty()) {
+        r.body.push_back(CHAIN_EPSILON);
+        r.origin.slots.push_back(r.origin.prods.size());
+      }
+      return r;
+    }
+
+    /* Adds to head the productions that are not unit of var, going through
+     * the unit ones. via is the unit production head -> var built so far. */
+    void units(size_t head, size_t var, const ChainRule *via,
+      std::set<std::vector<std::string>> &bodies) {
+      for (const size_t p : prods.productionsOf(var)) {
+        ChainRule r = (via == NULL)? base(p) : expand(*via, 0, base(p));
+        r.head = head;
+        if (isUnit(p)) {
+          size_t next = varOf(r.body[0]);
+          if (visited[next] == stamp) continue;
+          visited[next] = stamp;
+          units(head, next, &r, bodies);
+        } else if (bodies.insert(r.body).second) {
+          rules[head].push_back(r);
+        }
+      }
+    }
+
+    /* Replaces every inlined variable of the rule by its production */
+    void inlineRule(ChainRule &rule, const std::vector<bool> &inlined) {
+      for (size_t k = 0; k < rule.body.size();) {
+        size_t v = varOf(rule.body[k]);
+        if (v == nvars || !inlined[v]) { k++; continue; }
+        // The only use of v, so its production is taken and not copied
+        ChainRule body = std::move(rules[v][0]);
+        inlineRule(body, inlined);
+        size_t n = body.body.size();
+        if (body.body[0].compare(CHAIN_EPSILON) == 0) n = 0;
+        rule = expand(rule, k, body);
+        if (rule.body[0].compare(CHAIN_EPSILON) == 0) break;
+        k += n;
+      }
+    }
+
+  public:
+    size_t nunits;   // Unit productions of the grammar
+    size_t ninlined; // Variables replaced by their only production
+
+    /* The ProductionSet must be indexed with the ids of varIds and origins
+     * has the origin of each production */
+    ChainCollapse(const ProductionSet &prods_,
+      const std::map<std::string, size_t> &varIds_,
+      const std::vector<ProdOrigin> &origins_) :
+      prods(prods_), varIds(varIds_), origins(origins_) {
+      nvars = varIds.size();
+      start = (prods.empty())? 0 : varOf(prods.variable(0));
+      nunits = 0; ninlined = 0; stamp = 0;
+    }
+
+    /* Returns the productions of the new grammar, the ones of the start
+     * symbol first and the rest by variable id */
+    std::vector<ChainRule> run() {
+      std::vector<ChainRule> out;
+      std::vector<size_t> queue, uses(nvars, 0);
+      std::vector<bool> reached(nvars, false), inlined(nvars, false);
+
+      if (prods.empty()) return out;
+      for (size_t p = 0; p < prods.size(); p++) if (isUnit(p)) nunits++;
+
+      // Expand the units of the variables reached from the start symbol
+      rules.assign(nvars, std::vector<ChainRule>());
+      visited.assign(nvars, 0);
+      queue.push_back(start);
+      reached[start] = true;
+      for (size_t i = 0; i < queue.size(); i++) {
+        const size_t v = queue[i];
+        std::set<std::vector<std::string>> bodies;
+        visited[v] = ++stamp;
+        units(v, v, NULL, bodies);
+        // Only cycles of units, it derives nothing and stays like that
+        if (rules[v].empty())
+          for (const size_t p : prods.productionsOf(v))
+            rules[v].push_back(base(p));
+        for (const ChainRule &rule : rules[v])
+          for (const std::string &elem : rule.body) {
+            size_t w = varOf(elem);
+            if (w == nvars) continue;
+            uses[w] += (w != v)? 1 : 2; // Recursive ones are never inlined
+            if (!reached[w]) { reached[w] = true; queue.push_back(w); }
+          }
+      }
+
+      // Inline the variables with one production used once
+      for (const size_t v : queue)
+        if (v != start && rules[v].size() == 1 && uses[v] == 1) {
+          inlined[v] = true;
+          ninlined++;
+        }
+      for (size_t v = 0; v <= nvars; v++) {
+        const size_t w = (v == 0)? start : v - 1;
+        if ((v > 0 && w == start) || !reached[w] || inlined[w]) continue;
+        for (ChainRule &rule : rules[w]) {
+          inlineRule(rule, inlined);
+          out.push_back(rule);
+        }
+      }
+      return out;
+    }
+};
+
+#endif
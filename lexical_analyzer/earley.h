@@ -0,0 +1,230 @@
+#ifndef earley_recognizer
+#define earley_recognizer
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "production_set.h"
+
+#define EARLEY_EPSILON "''"
+
+/* Earley recognizer for any context free grammar. The productions are
+ * compiled to dotted rules identified by an integer, so every item of the
+ * chart is just two integers: the dotted rule and the set where it started.
+ * Nullable variables are skipped while predicting (Aycock and Horspool) and
+ * right recursive chains are completed in one step with Leo items, which
+ * keeps the chart linear for unambiguous LR-regular inputs. */
+class EarleyRecognizer {
+  private:
+    struct Item {
+      uint32_t rule;   // Dotted rule
+      uint32_t origin; // Set where the item was predicted
+    };
+
+    struct LeoItem {
+      int variable;
+      bool found;
+      Item top;
+    };
+
+    int nvars;
+    int start;
+    std::map<std::string, int> termIds; // Terminal to symbol id (>= nvars)
+    std::vector<int> dotSym;    // Symbol after the dot or -1 if complete
+    std::vector<int> dotHead;   // Variable of the dotted rule
+    std::vector<size_t> initOffsets; // Variable v predicts init[initOffsets[v]..]
+    std::vector<uint32_t> init;      // First dotted rule of each production
+    std::vector<bool> nullable;
+
+    /* Chart of the string being recognized. Every call to recognize has its
+     * own, so a compiled recognizer can be used from many threads. */
+    struct Chart {
+      std::vector<Item> items;
+      std::vector<size_t> sets;    // Set i is items[sets[i]..sets[i+1])
+      std::vector<std::vector<LeoItem>> leo;
+      std::vector<bool> seen;      // Items predicted in the current set
+      std::unordered_set<uint64_t> seenOld; // The rest of items
+    };
+
+    /* Adds an item to the current set if it was not already there */
+    void add(Chart &chart, uint32_t rule, uint32_t origin,
+      size_t current) const {
+      if (origin == current) {
+        if (chart.seen[rule]) return;
+        chart.seen[rule] = true;
+      } else if (!chart.seenOld.insert(((uint64_t)origin << 32)|rule).second) {
+        return;
+      }
+      chart.items.push_back(Item{rule, origin});
+    }
+
+    /* Returns the topmost item of a deterministic chain of completions of the
+     * variable started at set j, if there is one. */
+    bool leoTop(Chart &chart, size_t j, int variable, Item &top) const {
+      const std::vector<Item> &items = chart.items;
+      const std::vector<size_t> &sets = chart.sets;
+
+      for (const LeoItem &memo : chart.leo[j])
+        if (memo.variable == variable) { top = memo.top; return memo.found; }
+
+      LeoItem memo{variable, false, Item{0, 0}};
+      const Item *waiting = NULL;
+      size_t count = 0;
+      for (size_t k = sets[j]; k < sets[j+1]; k++)
+        if (dotSym[items[k].rule] == variable) { waiting = &items[k]; count++; }
+      // The acceptance also waits for the start symbol in the first set, so
+      // its completed items are never skipped
+      if (j == 0 && variable == start) count++;
+
+      // Only one item waits for the variable and it is the last symbol
+      if (count == 1 && waiting != NULL && dotSym[waiting->rule + 1] == -1) {
+        Item cand = Item{waiting->rule + 1, waiting->origin};
+        memo.found = true;
+        if (cand.origin >= j ||
+            !leoTop(chart, cand.origin, dotHead[waiting->rule], memo.top))
+          memo.top = cand;
+      }
+      chart.leo[j].push_back(memo);
+      top = memo.top;
+      return memo.found;
+    }
+
+  public:
+    EarleyRecognizer() { nvars = 0; start = -1; }
+
+    /* Compiles the productions. The ids of the variables must be the ones
+     * used to index the ProductionSet. The start symbol is the variable of
+     * the first production. */
+    void compile(const ProductionSet &prods,
+      const std::map<std::string, size_t> &varIds, size_t nvars_) {
+      std::map<std::string, size_t>::const_iterator it;
+      std::vector<std::vector<uint32_t>> byVar(nvars_);
+
+      nvars = nvars_;
+      termIds.clear();
+      dotSym.clear();
+      dotHead.clear();
+      start = (prods.empty())? -1 : varIds.at(prods.variable(0));
+
+      for (size_t p = 0; p < prods.size(); p++) {
+        int head = varIds.at(prods.variable(p));
+        byVar[head].push_back(dotSym.size());
+        for (const std::string &elem : prods.elements(p)) {
+          if (elem.compare(EARLEY_EPSILON) == 0) continue;
+          if ((it = varIds.find(elem)) != varIds.end()) {
+            dotSym.push_back(it->second);
+          } else {
+            std::map<std::string, int>::iterator t = termIds.find(elem);
+            if (t == termIds.end())
+              t = termIds.insert(std::make_pair(elem,
+                nvars + (int)termIds.size())).first;
+            dotSym.push_back(t->second);
+          }
+          dotHead.push_back(head);
+        }
+        dotSym.push_back(-1);
+        dotHead.push_back(head);
+      }
+
+      initOffsets.assign(1, 0);
+      init.clear();
+      for (const std::vector<uint32_t> &rules : byVar) {
+        init.insert(init.end(), rules.begin(), rules.end());
+        initOffsets.push_back(init.size());
+      }
+
+      // A variable is nullable if one of its productions only has nullables
+      nullable.assign(nvars, false);
+      for (bool changed = true; changed;) {
+        changed = false;
+        for (int v = 0; v < nvars; v++) {
+          if (nullable[v]) continue;
+          for (size_t k = initOffsets[v]; k < initOffsets[v+1]; k++) {
+            uint32_t r = init[k];
+            while (dotSym[r] >= 0 && dotSym[r] < nvars && nullable[dotSym[r]])
+              r++;
+            if (dotSym[r] == -1) { nullable[v] = true; changed = true; break; }
+          }
+        }
+      }
+    }
+
+    /* Returns if the words (terminals) can be derived from the start symbol */
+    bool recognize(const std::vector<std::string> &words) const {
+      std::vector<int> tokens;
+      std::vector<Item> scanned;
+      Item top;
+
+      if (start < 0) return false;
+      for (const std::string &word : words) {
+        std::map<std::string, int>::const_iterator t = termIds.find(word);
+        if (t == termIds.end()) return false; // Unknown terminal
+        tokens.push_back(t->second);
+      }
+
+      Chart chart;
+      std::vector<Item> &items = chart.items;
+      std::vector<size_t> &sets = chart.sets;
+      std::vector<bool> &seen = chart.seen;
+      sets.assign(1, 0);
+      chart.leo.assign(tokens.size() + 1, std::vector<LeoItem>());
+      seen.assign(dotSym.size(), false);
+
+      for (size_t i = 0; i <= tokens.size(); i++) {
+        chart.seenOld.clear();
+        if (i == 0) {
+          for (size_t k = initOffsets[start]; k < initOffsets[start+1]; k++)
+            add(chart, init[k], 0, 0);
+        } else {
+          for (const Item &item : scanned)
+            add(chart, item.rule, item.origin, i);
+          scanned.clear();
+        }
+
+        for (size_t k = sets[i]; k < items.size(); k++) {
+          Item item = items[k];
+          int sym = dotSym[item.rule];
+
+          if (sym == -1) {
+            // Complete the items that were waiting for the variable
+            int head = dotHead[item.rule];
+            if (item.origin < i && leoTop(chart, item.origin, head, top)) {
+              add(chart, top.rule, top.origin, i);
+            } else {
+              size_t last = (item.origin == i)? items.size():sets[item.origin+1];
+              for (size_t w = sets[item.origin]; w < last; w++) {
+                if (dotSym[items[w].rule] == head)
+                  add(chart, items[w].rule + 1, items[w].origin, i);
+                if (item.origin == i) last = items.size();
+              }
+            }
+          } else if (sym < nvars) {
+            // Predict the variable, nullables are also skipped
+            for (size_t p = initOffsets[sym]; p < initOffsets[sym+1]; p++)
+              add(chart, init[p], i, i);
+            if (nullable[sym]) add(chart, item.rule + 1, item.origin, i);
+          } else if (i < tokens.size() && tokens[i] == sym) {
+            scanned.push_back(Item{item.rule + 1, item.origin});
+          }
+        }
+        sets.push_back(items.size());
+        for (size_t k = sets[i]; k < sets[i+1]; k++)
+          if (items[k].origin == i) seen[items[k].rule] = false;
+
+        if (i < tokens.size() && scanned.empty()) return false;
+      }
+
+      // Accepted if the start symbol was completed from the first set
+      size_t n = tokens.size();
+      for (size_t k = sets[n]; k < sets[n+1]; k++)
+        if (dotSym[items[k].rule] == -1 && dotHead[items[k].rule] == start &&
+            items[k].origin == 0)
+          return true;
+      return false;
+    }
+};
+
+#endif
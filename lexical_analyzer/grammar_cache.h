@@ -0,0 +1,137 @@
+#ifndef grammar_cache
+#define grammar_cache
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lexical_analyzer.h"
+
+/* Returns the canonical text of a set of rules: every rule with its words
+ * separated by a single space, the first rule (it names the start symbol)
+ * followed by the rest sorted and without repetitions. Two submissions of
+ * the same grammar get the same text no matter the spacing or the order. */
+inline std::string canonicalGrammar(
+  const std::list<std::string> &rules) {
+  std::vector<std::string> normalized;
+  std::string canonical;
+
+  for (const std::string &rule : rules) {
+    std::string line;
+    for (const std::string &word : LexicalAnalyzer::splitWords(rule)) {
+      line.append(word);
+      line.append(" ");
+    }
+    if (!line.empty()) line.pop_back();
+    normalized.push_back(line);
+  }
+  if (normalized.empty()) return canonical;
+
+  canonical = normalized.front();
+  canonical.append("\n");
+  std::sort(normalized.begin() + 1, normalized.end());
+  normalized.erase(std::unique(normalized.begin()+1, normalized.end()),
+    normalized.end());
+  for (auto it = normalized.begin() + 1; it != normalized.end(); it++) {
+    canonical.append(*it);
+    canonical.append("\n");
+  }
+  return canonical;
+}
+
+/* 64 bit FNV-1a hash used as the address of a grammar in the cache */
+inline uint64_t grammarHash(const std::string &canonical) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const unsigned char c : canonical) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/* Least recently used cache of analyzed grammars addressed by the hash of
+ * their canonical text. The text is kept to tell apart hash collisions. */
+class GrammarCache {
+  private:
+    struct Entry {
+      uint64_t key;
+      std::string canonical;
+      std::shared_ptr<LexicalAnalyzer> analyzer;
+    };
+
+    size_t capacity;
+    std::list<Entry> entries; // Most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    size_t hits, misses;
+
+  public:
+    GrammarCache(size_t capacity_) : capacity(capacity_) {
+      if (capacity == 0) capacity = 1;
+      hits = 0; misses = 0;
+    }
+
+    /* Returns the analyzer of the grammar, analyzing it only if it is not in
+     * the cache. The key of the grammar is written on key and cached tells if
+     * the analysis was skipped. A new analysis copies what it can from the
+     * analysis of previous, an earlier version of the grammar, if there is
+     * one (see LexicalAnalyzer::reanalyze). */
+    std::shared_ptr<LexicalAnalyzer> get(const std::list<std::string> &rules,
+      uint64_t &key, bool &cached, const LexicalAnalyzer *previous = NULL) {
+      std::string canonical = canonicalGrammar(rules);
+      key = grammarHash(canonical);
+
+      auto it = index.find(key);
+      if (it != index.end() && it->second->canonical == canonical) {
+        entries.splice(entries.begin(), entries, it->second);
+        hits++;
+        cached = true;
+        return entries.front().analyzer;
+      }
+
+      misses++;
+      cached = false;
+      std::shared_ptr<LexicalAnalyzer> analyzer(new LexicalAnalyzer());
+      std::list<std::string> lines;
+      std::istringstream text(canonical);
+      std::string line;
+      while (std::getline(text, line)) lines.push_back(line);
+      if (!analyzer->parse(lines, previous == NULL)) return nullptr;
+      if (previous != NULL) analyzer->reanalyze(*previous);
+
+      // A collision replaces the older grammar
+      if (it != index.end()) {
+        entries.erase(it->second);
+        index.erase(it);
+      }
+      entries.push_front(Entry{key, canonical, analyzer});
+      index[key] = entries.begin();
+      if (entries.size() > capacity) {
+        index.erase(entries.back().key);
+        entries.pop_back();
+      }
+      return analyzer;
+    }
+
+    /* Returns the analyzer with the received key or NULL if it was evicted */
+    std::shared_ptr<LexicalAnalyzer> find(uint64_t key) {
+      auto it = index.find(key);
+      if (it == index.end()) return nullptr;
+      entries.splice(entries.begin(), entries, it->second);
+      return entries.front().analyzer;
+    }
+
+    size_t size() const { return entries.size(); }
+
+    size_t getCapacity() const { return capacity; }
+
+    size_t getHits() const { return hits; }
+
+    size_t getMisses() const { return misses; }
+};
+
+#endif
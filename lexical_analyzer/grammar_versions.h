@@ -0,0 +1,222 @@
+#ifndef grammar_versions
+#define grammar_versions
+
+#include <algorithm>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "grammar_cache.h"
+#include "lexical_analyzer.h"
+
+#define VERSION_CHUNK 64
+#define VERSION_HISTORY 16
+#define VERSION_CACHE 32
+
+/* One version of a grammar. It never changes once it is published, so any
+ * number of threads can query it at the same time. The productions are
+ * stored in chunks shared with the version it was made from (an edit only
+ * copies the list of chunks and the chunk it touches). The analysis is
+ * shared with every other version that has the same grammar, and a new one
+ * copies FIRST and FOLLOW of the variables the edit can not have changed
+ * from the version it was made from. */
+class GrammarVersion {
+  private:
+    typedef std::vector<std::string> Chunk;
+
+    size_t id;
+    size_t count; // Productions
+    std::vector<std::shared_ptr<const Chunk>> chunks;
+    std::shared_ptr<LexicalAnalyzer> analyzer; // Prepared, never updated
+
+    friend class GrammarVersions;
+
+  public:
+    GrammarVersion() : id(0), count(0) {}
+
+    size_t getId() const { return id; }
+
+    size_t size() const { return count; }
+
+    std::list<std::string> getRules() const {
+      std::list<std::string> rules;
+      for (const std::shared_ptr<const Chunk> &chunk : chunks)
+        rules.insert(rules.end(), chunk->begin(), chunk->end());
+      return rules;
+    }
+
+    /* Returns how many chunks of productions both versions share */
+    size_t shared(const GrammarVersion &other) const {
+      size_t n = 0;
+      for (const std::shared_ptr<const Chunk> &chunk : chunks)
+        if (std::find(other.chunks.begin(), other.chunks.end(), chunk) !=
+            other.chunks.end()) n++;
+      return n;
+    }
+
+    bool validStr(const std::string &str) const {
+      return analyzer->accepts(str);
+    }
+
+    bool is_ll() const { return analyzer->is_ll(); }
+
+    std::list<std::string> getFirst(const std::string &str) const {
+      return analyzer->getFirst(str);
+    }
+
+    std::list<std::string> getFollow(const std::string &str) const {
+      return analyzer->getFollow(str);
+    }
+
+    /* Analyzer of the version, it must not be modified */
+    std::shared_ptr<const LexicalAnalyzer> getAnalyzer() const {
+      return analyzer;
+    }
+};
+
+/* Keeps the versions of a grammar that is edited while other threads read
+ * it. Every edit makes a new version from the current one and switches to
+ * it. Readers take the current version with get() and keep using it for as
+ * long as they like. get() is a std::atomic_load of the shared pointer,
+ * which the library guards with a small spin lock, so it is not lock free,
+ * but it is never held during an analysis: an edit analyzes first and then
+ * only swaps the pointer, like switching to another version and rolling
+ * back do. */
+class GrammarVersions {
+  private:
+    typedef GrammarVersion::Chunk Chunk;
+
+    std::shared_ptr<const GrammarVersion> current; // Only atomic access
+    std::deque<std::shared_ptr<const GrammarVersion>> history; // Oldest first
+    std::mutex lock; // Taken by the writers
+    GrammarCache cache; // Analyses by grammar, shared by versions
+    size_t nextId, maxHistory;
+
+    /* Returns the rule with its words separated by a single space */
+    static std::string normalize(const std::string &rule) {
+      std::string text = canonicalGrammar(std::list<std::string>{rule});
+      if (!text.empty()) text.pop_back(); // Pop last '\n'
+      return text;
+    }
+
+    /* Makes a version the current one and keeps it in the history */
+    void switchTo(const std::shared_ptr<const GrammarVersion> &version) {
+      history.push_back(version);
+      if (history.size() > maxHistory) history.pop_front();
+      std::atomic_store(&current, version);
+    }
+
+    /* Analyzes a new version (or takes the analysis of an equal grammar)
+     * and switches to it */
+    std::shared_ptr<const GrammarVersion> publish(
+      std::shared_ptr<GrammarVersion> version) {
+      uint64_t key;
+      bool cached;
+
+      version->id = nextId++;
+      version->analyzer = cache.get(version->getRules(), key, cached,
+        (current != nullptr)? current->analyzer.get() : NULL);
+      if (version->analyzer == nullptr) return nullptr;
+      version->analyzer->prepare();
+      switchTo(version);
+      return version;
+    }
+
+  public:
+    GrammarVersions(size_t maxHistory_ = VERSION_HISTORY,
+      size_t cacheCapacity = VERSION_CACHE) : cache(cacheCapacity) {
+      nextId = 0;
+      maxHistory = (maxHistory_ == 0)? 1 : maxHistory_;
+      std::lock_guard<std::mutex> guard(lock);
+      publish(std::shared_ptr<GrammarVersion>(new GrammarVersion()));
+    }
+
+    /* Current version. It stays valid after later edits. */
+    std::shared_ptr<const GrammarVersion> get() const {
+      return std::atomic_load(&current);
+    }
+
+    /* Makes a version with the productions added at the end. Returns it, or
+     * NULL and changes nothing if a production is not valid. */
+    std::shared_ptr<const GrammarVersion> add(
+      const std::list<std::string> &rules) {
+      std::string variable;
+      std::vector<std::string> elements;
+      std::lock_guard<std::mutex> guard(lock);
+      std::shared_ptr<GrammarVersion> next(new GrammarVersion(*current));
+      std::shared_ptr<Chunk> last; // Chunk already copied by this edit
+
+      for (const std::string &rule : rules) {
+        if (!LexicalAnalyzer::splitRule(rule, variable, elements))
+          return nullptr;
+        if (last == nullptr || last->size() >= VERSION_CHUNK) {
+          if (!next->chunks.empty() && next->chunks.back()->size()<VERSION_CHUNK){
+            last.reset(new Chunk(*next->chunks.back()));
+            next->chunks.back() = last;
+          } else {
+            last.reset(new Chunk());
+            next->chunks.push_back(last);
+          }
+        }
+        last->push_back(normalize(rule));
+        next->count++;
+      }
+      return publish(next);
+    }
+
+    std::shared_ptr<const GrammarVersion> add(const std::string &rule) {
+      return add(std::list<std::string>{rule});
+    }
+
+    /* Makes a version without the first copy of the production. Returns it,
+     * or NULL and changes nothing if the current version does not have it. */
+    std::shared_ptr<const GrammarVersion> remove(const std::string &rule) {
+      const std::string text = normalize(rule);
+      std::lock_guard<std::mutex> guard(lock);
+
+      for (size_t c = 0; c < current->chunks.size(); c++) {
+        const Chunk &chunk = *current->chunks[c];
+        Chunk::const_iterator it = std::find(chunk.begin(), chunk.end(), text);
+        if (it == chunk.end()) continue;
+
+        std::shared_ptr<GrammarVersion> next(new GrammarVersion(*current));
+        if (chunk.size() == 1) {
+          next->chunks.erase(next->chunks.begin() + c);
+        } else {
+          std::shared_ptr<Chunk> copy(new Chunk(chunk));
+          copy->erase(copy->begin() + (it - chunk.begin()));
+          next->chunks[c] = copy;
+        }
+        next->count--;
+        return publish(next);
+      }
+      return nullptr;
+    }
+
+    /* Makes a version the current one again */
+    void checkout(const std::shared_ptr<const GrammarVersion> &version) {
+      std::lock_guard<std::mutex> guard(lock);
+      if (version != nullptr) switchTo(version);
+    }
+
+    /* Goes back to the version that was current before the last edit or
+     * checkout. Returns false if the history has nothing older. */
+    bool rollback() {
+      std::lock_guard<std::mutex> guard(lock);
+      if (history.size() < 2) return false;
+      history.pop_back();
+      std::atomic_store(&current, history.back());
+      return true;
+    }
+
+    /* Versions that rollback can go back to, counting the current one */
+    size_t historySize() {
+      std::lock_guard<std::mutex> guard(lock);
+      return history.size();
+    }
+};
+
+#endif
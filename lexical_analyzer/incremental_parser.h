@@ -0,0 +1,173 @@
+#ifndef incremental_parser
+#define incremental_parser
+
+#include <string>
+#include <vector>
+
+#include "lexical_analyzer.h"
+
+#define CHECKPOINT_EVERY 1024
+
+/* Validates a string with the LL table of an analyzer and keeps a snapshot
+ * of the predictive stack every few terminals. After an edit the parse is
+ * resumed from the last snapshot before the edit and it stops as soon as
+ * the stack is the same as the one of the previous parse at the same
+ * (shifted) position, because from there on both parses are equal. The
+ * analyzer must not be updated while the parser is used; if it is not LL
+ * every string is rejected at its first word. */
+class IncrementalParser {
+  private:
+    struct Checkpoint {
+      size_t pos;             // Terminals read before the snapshot
+      std::vector<int> stack; // Predictive stack at that point
+    };
+
+    const LexicalAnalyzer &analyzer;
+    size_t every; // Terminals between snapshots
+    std::vector<int> terms; // Ids of the words of the string
+    std::vector<Checkpoint> checkpoints; // Sorted by position
+    bool accepted;
+    size_t errorPos; // First terminal that could not be read
+    size_t work;     // Terminals read by the last parse or edit
+
+    /* Ids of the words of a string */
+    std::vector<int> ids(const std::string &str) const {
+      std::vector<int> out;
+      for (const std::string &word : LexicalAnalyzer::splitWords(str))
+        out.push_back(analyzer.terminalId(word));
+      return out;
+    }
+
+    /* Rejects the string at its first word when there is no LL table */
+    bool rejectNotLL() {
+      checkpoints.clear();
+      accepted = false;
+      errorPos = 0;
+      work = 0;
+      return false;
+    }
+
+    /* Parses from a checkpoint. The old checkpoints after it must already
+     * have the positions of the edited string; when the parse reaches one of
+     * them at or after syncFrom with the same stack, it joins the previous
+     * parse and only moves its result by delta. */
+    void run(size_t from, size_t syncFrom, long delta) {
+      const int end = analyzer.termNames.size() - 1;
+      std::vector<Checkpoint> fresh;
+      std::vector<int> stack = checkpoints[from].stack;
+      size_t pos = checkpoints[from].pos, last = pos, old = from + 1;
+
+      work = 0;
+      while (true) {
+        while (old < checkpoints.size() && checkpoints[old].pos < pos) old++;
+        if (pos >= syncFrom && old < checkpoints.size() &&
+            checkpoints[old].pos == pos) {
+          if (checkpoints[old].stack == stack) {
+            // The rest is the same as the previous parse
+            fresh.insert(fresh.end(),
+              std::make_move_iterator(checkpoints.begin() + old),
+              std::make_move_iterator(checkpoints.end()));
+            errorPos += delta;
+            break;
+          }
+          fresh.push_back(Checkpoint{pos, stack});
+          last = pos;
+        } else if (pos - last >= every) {
+          fresh.push_back(Checkpoint{pos, stack});
+          last = pos;
+        }
+
+        work++;
+        if (pos == terms.size()) {
+          accepted = analyzer.step(stack, end);
+          errorPos = (accepted)? terms.size() + 1 : pos;
+          break;
+        }
+        if (terms[pos] < 0 || !analyzer.step(stack, terms[pos])) {
+          accepted = false;
+          errorPos = pos;
+          break;
+        }
+        pos++;
+      }
+
+      checkpoints.resize(from + 1);
+      checkpoints.insert(checkpoints.end(),
+        std::make_move_iterator(fresh.begin()),
+        std::make_move_iterator(fresh.end()));
+    }
+
+  public:
+    IncrementalParser(const LexicalAnalyzer &analyzer_,
+      size_t every_ = CHECKPOINT_EVERY) : analyzer(analyzer_) {
+      every = (every_ == 0)? 1 : every_;
+      accepted = false;
+      errorPos = 0;
+      work = 0;
+    }
+
+    /* Validates a whole string. Returns if it is valid. */
+    bool parse(const std::string &str) {
+      terms = ids(str);
+      if (!analyzer.isLL) return rejectNotLL();
+      checkpoints.clear();
+      checkpoints.push_back(Checkpoint{0, analyzer.startStack()});
+      run(0, terms.size() + 1, 0);
+      return accepted;
+    }
+
+    /* Replaces count words starting at word from with the words of the
+     * replacement and validates the new string. Returns if it is valid. */
+    bool edit(size_t from, size_t count, const std::string &replacement) {
+      std::vector<int> added = ids(replacement);
+      long delta;
+      size_t c;
+
+      if (from > terms.size()) from = terms.size();
+      if (count > terms.size() - from) count = terms.size() - from;
+      delta = (long)added.size() - (long)count;
+
+      terms.erase(terms.begin() + from, terms.begin() + from + count);
+      terms.insert(terms.begin() + from, added.begin(), added.end());
+      if (!analyzer.isLL) return rejectNotLL();
+      if (checkpoints.empty()) {
+        // Never parsed, there is nothing to reuse
+        checkpoints.push_back(Checkpoint{0, analyzer.startStack()});
+        run(0, terms.size() + 1, 0);
+        return accepted;
+      }
+
+      // An error before the edit does not change
+      if (!accepted && errorPos < from) { work = 0; return false; }
+
+      // Move the snapshots after the edit, drop the ones inside it
+      c = 0;
+      while (c + 1 < checkpoints.size() && checkpoints[c+1].pos <= from) c++;
+      std::vector<Checkpoint> kept;
+      for (size_t i = c + 1; i < checkpoints.size(); i++)
+        if (checkpoints[i].pos >= from + count) {
+          checkpoints[i].pos += delta;
+          kept.push_back(std::move(checkpoints[i]));
+        }
+      checkpoints.resize(c + 1);
+      checkpoints.insert(checkpoints.end(),
+        std::make_move_iterator(kept.begin()),
+        std::make_move_iterator(kept.end()));
+
+      run(c, from + added.size(), delta);
+      return accepted;
+    }
+
+    bool isValid() const { return accepted; }
+
+    /* Position of the first word that could not be read, the amount of words
+     * if the string ended too soon, or more than that if it is valid */
+    size_t getErrorPos() const { return errorPos; }
+
+    /* Terminals read by the last parse or edit */
+    size_t getWork() const { return work; }
+
+    size_t size() const { return terms.size(); }
+};
+
+#endif
@@ -2,71 +2,74 @@
 #define lexical_analyzer
 
 #include <algorithm>
+#include <cstdio>
 #include <exception>
 #include <iterator>
 #include <list>
 #include <map>
-#include <regex>
+#include <memory>
+#include <stack>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include "analysis_control.h"
+#include "chain_collapse.h"
+#include "earley.h"
+#include "memory_account.h"
+#include "operator_precedence.h"
+#include "production_set.h"
+#include "recognition_profile.h"
+#include "regular_automaton.h"
+#include "result_cache.h"
+#include "small_stack.h"
+#include "sparse_table.h"
+#include "symbol_sets.h"
+#include "terminal_hash.h"
+#include "thread_pool.h"
+#include "utf8.h"
 
-#define RULEREGEX "([A-Za-z_-]+) ?-> ?(.*)"
 #define EPSILON "''"
+#define EPSILON_CODE 0x7fffffff
+#define PARALLEL_MIN_VARS 256
 
-char LABUFFER[255];
+// Log lines, one per thread so analyzers can work in parallel
+thread_local char LABUFFER[255];
 
-class Production {
-  private:
-    std::string variable;
-    std::list<std::string> elements;
-
-    friend class LexicalAnalyzer;
-
-  public:
-    Production(std::string variable) : variable(variable) {}
-
-    std::string toString() {
-      std::string str = variable;
-      str.append(" -> ");
-      for (const std::string elem : elements) {
-        str.append(elem);
-        str.append(" ");
-      }
-      str.pop_back();
-      return str;
-    }
-
-    std::string getVariable() const { return variable; }
-
-    std::list<std::string> getElements() const { return elements; }
-};
+class IncrementalParser;
+class PushParser;
+class TableExporter;
 
 class Variable {
   private:
     std::string name;
     int firVer; // Integer used for version control and optimize updates
-    std::list<std::string> first;
+    CountedList first;
     int folVer; // Integer used for version control and optimize updates
-    std::list<std::string> follow;
-    std::map<std::string, Production*> table;
+    CountedList follow;
 
     friend class LexicalAnalyzer;
+    friend class TableExporter;
 
     /* Function to update the current version of the first list */
     void updateFirst(std::list<std::string> first_, int version) {
-      first.clear();
-      first = first_;
+      first.assign(first_.begin(), first_.end());
       firVer = version;
     }
 
     /* Function to update the current version of the follow list */
     void updateFollow(std::list<std::string> follow_, int version) {
-      follow.clear();
-      follow = follow_;
+      follow.assign(follow_.begin(), follow_.end());
       folVer = version;
     }
 
   public:
-    Variable(std::string name_) : name(name_) { firVer=0; folVer=0; }
+    /* The lists are charged to the account, if there is one */
+    Variable(std::string name_, MemoryAccount *account = NULL) : name(name_),
+      first(CountingAllocator<char>(account, MemoryCategory::SETS)),
+      follow(first.get_allocator()) {
+      firVer=0; folVer=0; }
 
     bool operator == (const Variable &v) { return name.compare(v.name) == 0; }
 
@@ -95,129 +98,165 @@ class Variable {
         str.pop_back(); // Pop last ','
       }
 
-      str.append("}, MAP={");
-      if(!table.empty()) {
-        std::map<std::string, Production*>::iterator it;
-        for (it = table.begin(); it != table.end(); it++) {
-          sprintf(LABUFFER, "'%s': %s, ",
-            it->first.c_str(), it->second->toString().c_str());
-          str.append(LABUFFER);
-        }
-        str.pop_back(); str.pop_back();
-      }
       str.append("}");
 
       return str;
     }
 
-    std::list<std::string> getFirst() const { return first; }
+    std::list<std::string> getFirst() const {
+      return std::list<std::string>(first.begin(), first.end());
+    }
 
-    std::list<std::string> getFollow() const { return follow; }
+    std::list<std::string> getFollow() const {
+      return std::list<std::string>(follow.begin(), follow.end());
+    }
 }; 
 
+/* What the cleanup of a grammar found and removed */
+struct GrammarCleanup {
+  std::list<std::string> unproductive; // Variables that derive no string
+  std::list<std::string> unreachable;  // Variables not used from the start
+  std::list<std::string> nullable;     // Kept variables that derive ''
+  std::list<std::string> terminals;    // Terminals that are no longer used
+  std::list<std::string> productions;  // Removed productions
+  bool empty; // The start symbol derives no string, nothing was removed
+};
+
+/* What collapseChains replaced */
+struct GrammarChains {
+  size_t units;   // Unit productions replaced by what their variable derives
+  size_t inlined; // Variables replaced by their only production
+  std::list<std::string> removed; // Variables that are no longer used
+};
+
+/* What the recognizer found in a string, see LexicalAnalyzer::diagnose */
+struct StrDiagnosis {
+  bool valid;
+  size_t position; // Word where it stopped or RESULT_NO_POSITION
+  std::list<std::string> expected; // Terminals that could have been there
+};
+
 class LexicalAnalyzer {
   private:
+    // Bytes used by the containers, shared by copies of the analyzer
+    std::shared_ptr<MemoryAccount> memory{new MemoryAccount()};
     int ver; // Version control
     bool isLL;
-    std::list<Variable> vars; // Syntathic variables
+    std::vector<Variable> vars; // Syntathic variables
+    std::map<std::string, size_t> varIds; // Position of each variable in vars
     std::list<std::string> terms; // Terminals
-    std::list<Production> prods; // All productions
+    ProductionSet prods{memory.get()}; // All productions
+    EarleyRecognizer earley; // Used when the grammar is not LL
+    int earleyVer; // Version of the grammar compiled in earley
+    OperatorPrecedence precedence; // Used when the grammar is not LL
+    bool isOP; // Operator precedence grammar
+    // Variables read with operator precedence when the rest of the grammar
+    // is LL, like the expressions of a language of statements
+    std::vector<OperatorPrecedence> expressions;
+    std::vector<int> expressionOf; // By variable, index in expressions or -1
+    bool isMixed; // LL with operator precedence expressions
+    RegularAutomaton automaton; // Used when the grammar is right/left linear
+    bool isRegular; // Right or left linear grammar
+    // Productions before the first collapseChains and the ones each
+    // production stands for, both empty if it never ran
+    std::vector<std::string> originalProds;
+    std::vector<ProdOrigin> prodOrigins;
+    // Results of strings, shared by copies until one of them updates
+    std::shared_ptr<ResultCache> results;
+    // Expansions counted while profiling, NULL if it is off
+    std::shared_ptr<RecognitionProfile> profile;
+
+    // Terminal of each id, "$" is last
+    CountedVector<std::string> termNames{counted(MemoryCategory::SYMBOLS)};
+    std::map<std::string, size_t> termIds;
+    TerminalHash termHash{memory.get()}; // Word to terminal id
+    // Elements of prods encoded by calcSymbols
+    CountedVector<int> codes{counted(MemoryCategory::SYMBOLS)};
+    // Derive EPSILON
+    CountedVector<bool> nullable{counted(MemoryCategory::SETS)};
+    CountedVector<bool> prodNullable{counted(MemoryCategory::SETS)};
+    // By variable id
+    CountedVector<TermSet> firstSets{counted(MemoryCategory::SETS)};
+    CountedVector<TermSet> followSets{counted(MemoryCategory::SETS)};
+    // FIRST of each right hand side
+    CountedVector<TermSet> prodFirst{counted(MemoryCategory::SETS)};
+    // Production by variable and terminal id or -1
+    SparseTable llTable{counted(MemoryCategory::TABLES)};
+    // Production of each variable that drifts to ''
+    CountedVector<int> nullProd{counted(MemoryCategory::TABLES)};
+
+    size_t nthreads; // Threads used to solve FIRST and FOLLOW
+    // Analysis of the grammar before an edit, set only during reanalyze
+    const LexicalAnalyzer *previous;
+    std::vector<int> previousVar; // Id in previous of each variable or -1
+    std::vector<size_t> previousTerm; // Id of each terminal of previous
+    std::vector<bool> sameFirst, sameFollow; // Sets copied from previous
+    size_t reused; // Variables with both sets copied by the last analysis
+    AnalysisPhase phase; // First phase of the analysis that is not done
+    const AnalysisControl *control; // Limits of the running analysis or NULL
+
+    // Thrown inside a phase when the control stops the analysis
+    struct Interrupted {};
+    std::shared_ptr<ThreadPool> pool;
 
-    std::list<std::string> cache;
     FILE *logFile;
     bool logging;
 
-    /* Function to log the activity of the lexical analyzer */
-    void log(const char str[]) {
-      if (logFile != NULL) fprintf(logFile, "%s", str);
-    }
+    friend class IncrementalParser;
+    friend class PushParser;
+    friend class TableExporter;
 
-    /* Returns a boolean that confirms if the received string is part of the
-     * cache to avoid recursion */
-    bool inCache(std::string str) {
-      return std::find(cache.begin(), cache.end(), str) != cache.end();
+    /* Returns if the running analysis must stop */
+    bool interrupted() const { return control != NULL && control->stop(); }
+
+    /* Allocator that charges a category of the memory account */
+    CountingAllocator<char> counted(MemoryCategory category) const {
+      return CountingAllocator<char>(memory.get(), category);
     }
 
-    /* Logs the cache */
-    void logCache() {
-      if (logging) {
-        log("CACHE: ");
-        for(std::string e : cache) {
-          sprintf(LABUFFER, "%s ", e.c_str());
-          log(LABUFFER);
-        }
-        log("\n");
-      }
+    /* Function to log the activity of the lexical analyzer */
+    void log(const char str[]) {
+      if (logFile != NULL) fprintf(logFile, "%s", str);
     }
 
     /* Returns a boolean that confirms if the received string is part of the
      * synthatic variables */
-    bool hasVar(std::string &str) {
-      return std::find(vars.begin(), vars.end(), str) != vars.end();
+    bool hasVar(const std::string &str) {
+      return varIds.find(str) != varIds.end();
     }
 
     /* Returns the pointer to the Variable instance according to a string. If
      * the variable is not found, then it returns NULL */
-    Variable * getVar(const std::string str) {
-      std::list<Variable>::iterator it = std::find(vars.begin(),vars.end(),str);
-      if(it == vars.end()) return NULL;
-      return &(*it);
+    Variable * getVar(const std::string &str) {
+      std::map<std::string, size_t>::iterator it = varIds.find(str);
+      if(it == varIds.end()) return NULL;
+      return &vars[it->second];
     }
 
     /* Returns a boolean that confirms if the received string is part of the
      * terminals */
-    bool hasTerm(std::string &str) {
+    bool hasTerm(const std::string &str) {
       return std::find(terms.begin(), terms.end(), str) != terms.end();
     }
 
-    /* Returns a list of productions where the received string is the
-     * variable */
-    std::list<Production> productions(std::string &var) {
-      std::list<Production> list;
-      for (Production prod : prods)
-        if(var == prod.variable) list.push_back(prod);
-      return list;
+    /* Returns the ids of the productions where the received string is the
+     * variable. The span points inside prods so nothing is copied. */
+    Span<size_t> productions(const std::string &var) {
+      std::map<std::string, size_t>::iterator it = varIds.find(var);
+      if (it == varIds.end()) return Span<size_t>();
+      return prods.productionsOf(it->second);
     }
 
-    /* Runs a calculation for returning first of a specific string.
-     * Returns the list of firsts for an specific string. */
-    std::list<std::string> calcFirst(std::string str) {
+    /* Returns the FIRST of a symbol. Variables return the set calculated on
+     * the last update. */
+    std::list<std::string> calcFirst(const std::string &str) {
       std::list<std::string> firsts;
       Variable *v;
 
       // First rule: first of a terminal
       if (hasTerm(str) || str.compare(EPSILON) == 0) firsts.push_back(str);
-      else if ( (v=getVar(str)) != NULL) {
-        // Ignores if the version is updated
-        if (v->firVer == ver) return v->first;
-
-        // Version is not updated thus needs to update
-        for (const Production production : prods) {
-          if (str.compare(production.variable) == 0 &&
-              str.compare(production.elements.front()) != 0) {
-            // First of the first element of the production
-            std::list<std::string> ff = calcFirst(production.elements.front());
-
-            // Find if it has epsilon
-            if (std::find(ff.begin(), ff.end(), EPSILON) != ff.end() &&
-                production.elements.size() > 1) {
-              ff.remove(EPSILON);
-              // Also add the first of the following element
-              ff.splice(ff.end(),
-                calcFirst(*std::next(production.elements.begin())));
-            }
-
-            firsts.splice(firsts.end(), ff);
-          }
-        }
-
-        // Clean list
-        firsts.sort();
-        firsts.unique();
-
-        // Update var version
-        v->updateFirst(firsts, ver);
-      } else {
+      else if ( (v=getVar(str)) != NULL) return v->getFirst();
+      else {
         fprintf(stderr, "Not part of synthatic variabels or terminals (%s)!\n",
           str.c_str());
         throw std::runtime_error("Not part of variables or terminals!");
@@ -226,11 +265,8 @@ class LexicalAnalyzer {
       return firsts;
     }
 
-    /* Runs a calculation for returning follow of a specific string.
-     * Returns the list of follows. */
-    std::list<std::string> calcFollow(std::string str) {
-      std::list<std::string> follows;
-      bool first = true;
+    /* Returns the FOLLOW of a variable calculated on the last update. */
+    std::list<std::string> calcFollow(const std::string &str) {
       Variable *v = getVar(str);
 
       if (v == NULL) {
@@ -238,169 +274,556 @@ class LexicalAnalyzer {
           str.c_str());
         throw std::runtime_error("Not part of variables!");
       }
+      return v->getFollow();
+    }
 
-      // Ignores if the version is updated
-      if (v->folVer == ver) return v->follow;
+    /* Returns the pool used to solve the sets, or NULL if the grammar is too
+     * small to be worth the threads */
+    ThreadPool * setsPool() {
+      if (nthreads <= 1 || vars.size() < PARALLEL_MIN_VARS) return NULL;
+      if (pool == nullptr || pool->size() != nthreads)
+        pool = std::shared_ptr<ThreadPool>(new ThreadPool(nthreads));
+      return pool.get();
+    }
 
-      if (logging) {
-        sprintf(LABUFFER, "calcFollow(%s) ", str.c_str()); log(LABUFFER);
-        logCache();
+    /* Gives an id to every terminal ("$" is the last one) and encodes every
+     * element of the productions: terminals keep their id, variables are
+     * stored as -1 - id and EPSILON as EPSILON_CODE. */
+    void calcSymbols() {
+      std::map<std::string, size_t>::iterator it;
+
+      termNames.assign(terms.begin(), terms.end());
+      termNames.push_back("$");
+      termIds.clear();
+      for (size_t t = 0; t < termNames.size(); t++) termIds[termNames[t]] = t;
+      if (!termHash.build(Span<std::string>(termNames.data(),
+          termNames.data() + termNames.size()))) {
+        fprintf(stderr, "Could not hash the terminals!\n");
+        throw std::runtime_error("Could not hash the terminals!");
       }
 
-      // Follow needs to be updated
-      for (const Production prod : prods) {
-        // First rule
-        if (first && prod.variable.compare(str) == 0) follows.push_back("$");
-
-        for (auto it = prod.elements.begin(); it != prod.elements.end(); it++) {
-          if (it->compare(str) == 0) {
-            // See next terminal
-            if (it!=prod.elements.end() && std::next(it)!=prod.elements.end()) {
-              // Second rule
-              // FIRST of the following terminal
-              std::list<std::string> fnext = this->calcFirst(*std::next(it));
-              follows.insert(follows.end(), fnext.begin(), fnext.end());
-
-              // Third rule
-              // If next can be EPSILON, then follow the variable
-              if (str.compare(prod.variable) != 0 &&
-                  std::find(fnext.begin(),fnext.end(),EPSILON) != fnext.end()){
-                cache.push_back(str);
-                follows.splice(follows.end(), calcFollow(prod.variable));
-              }
-            } else if (str.compare(prod.variable) != 0 && !inCache(str)) {
-              // Third rule: Its the last one
-              cache.push_back(str);
-              follows.splice(follows.end(), calcFollow(prod.variable));
-            }
-          }
+      codes.clear();
+      for (size_t p = 0; p < prods.size(); p++)
+        for (const std::string &elem : prods.elements(p)) {
+          if (elem.compare(EPSILON) == 0) codes.push_back(EPSILON_CODE);
+          else if ((it = varIds.find(elem)) != varIds.end())
+            codes.push_back(-1 - (int)it->second);
+          else codes.push_back(termIds[elem]);
+        }
+    }
+
+    /* Finds the variables and productions that derive EPSILON. Every
+     * production counts the elements that are not known to be nullable and
+     * when a variable becomes nullable only the productions that use it are
+     * visited again. */
+    void calcNullable() {
+      std::vector<size_t> missing(prods.size(), 0), queue;
+
+      nullable.assign(vars.size(), false);
+      prodNullable.assign(prods.size(), false);
+      for (size_t p = 0; p < prods.size(); p++) {
+        for (size_t i = prods.offset(p); i < prods.offset(p+1); i++)
+          if (codes[i] != EPSILON_CODE) missing[p]++;
+        if (missing[p] == 0) queue.push_back(p);
+      }
+
+      while (!queue.empty()) {
+        size_t p = queue.back(), v = varIds[prods.variable(p)];
+        queue.pop_back();
+        prodNullable[p] = true;
+        if (nullable[v]) continue;
+        nullable[v] = true;
+        for (const Occurrence &occ : prods.occurrencesOf(v))
+          if (--missing[occ.prod] == 0) queue.push_back(occ.prod);
+      }
+    }
+
+    /* Adds the FIRST of the elements of a production from pos to its end.
+     * Returns if the set changed and writes on nullable_ if every element
+     * after pos can derive EPSILON. */
+    bool firstOfRest(size_t p, size_t pos, TermSet &set, bool &nullable_) {
+      bool changed = false;
+      nullable_ = false;
+      for (size_t i = pos; i < prods.offset(p+1); i++) {
+        int code = codes[i];
+        if (code == EPSILON_CODE) continue;
+        if (code < 0) {
+          changed |= set.merge(firstSets[-1 - code]);
+          if (!nullable[-1 - code]) return changed;
+        } else {
+          changed |= !set.has(code);
+          set.insert(code);
+          return changed;
         }
-        first = false;
       }
+      nullable_ = true;
+      return changed;
+    }
 
-      cache.remove(str);
+    /* Finds the variables whose sets can not differ from the ones they had
+     * in previous. FIRST and EPSILON only depend on the variables reached
+     * from a variable, so it keeps them if it reaches no variable whose
+     * productions changed. FOLLOW depends on the productions that use a
+     * variable, so the variables of changed productions (before and after
+     * the edit), of productions with a changed FIRST and every variable they
+     * reach lose it. Returns false if nothing can be copied. */
+    bool calcReusable() {
+      const LexicalAnalyzer &old = *previous;
+      std::vector<bool> changed(vars.size(), false);
+      std::vector<size_t> queue;
+      std::map<std::string, size_t>::const_iterator it;
+
+      sameFirst.clear();
+      sameFollow.clear();
+      if (old.phase != AnalysisPhase::DONE || prods.empty() ||
+          old.prods.empty() || old.firstSets.size() != old.vars.size() ||
+          old.followSets.size() != old.vars.size() ||
+          prods.variable(0) != old.prods.variable(0)) return false;
+
+      previousTerm.assign(old.termNames.size(), (size_t)-1);
+      for (size_t t = 0; t < old.termNames.size(); t++)
+        if ((it = termIds.find(old.termNames[t])) != termIds.end())
+          previousTerm[t] = it->second;
+
+      // Same productions, with every element still a variable or a terminal
+      previousVar.assign(vars.size(), -1);
+      for (size_t v = 0; v < vars.size(); v++) {
+        if ((it = old.varIds.find(vars[v].name)) == old.varIds.end()) {
+          changed[v] = true;
+          continue;
+        }
+        previousVar[v] = it->second;
+        Span<size_t> now = prods.productionsOf(v);
+        Span<size_t> before = old.prods.productionsOf(it->second);
+        changed[v] = now.size() != before.size();
+        for (size_t i = 0; i < now.size() && !changed[v]; i++) {
+          Span<std::string> a = prods.elements(now[i]);
+          Span<std::string> b = old.prods.elements(before[i]);
+          changed[v] = a.size() != b.size();
+          for (size_t j = 0; j < a.size() && !changed[v]; j++)
+            changed[v] = a[j] != b[j] ||
+              (varIds.count(a[j]) > 0) != (old.varIds.count(a[j]) > 0);
+        }
+      }
 
-      follows.remove(EPSILON);
-      follows.sort();
-      follows.unique();
+      sameFirst.assign(vars.size(), true);
+      for (size_t v = 0; v < vars.size(); v++)
+        if (changed[v]) { sameFirst[v] = false; queue.push_back(v); }
+      while (!queue.empty()) {
+        size_t v = queue.back();
+        queue.pop_back();
+        for (const Occurrence &occ : prods.occurrencesOf(v)) {
+          size_t head = varIds[prods.variable(occ.prod)];
+          if (sameFirst[head]) { sameFirst[head] = false; queue.push_back(head); }
+        }
+      }
 
-      // Update var version
-      v->updateFollow(follows, ver);
+      sameFollow.assign(vars.size(), true);
+      auto lose = [&](const std::string &elem) {
+        std::map<std::string, size_t>::const_iterator var = varIds.find(elem);
+        if (var != varIds.end() && sameFollow[var->second]) {
+          sameFollow[var->second] = false;
+          queue.push_back(var->second);
+        }
+      };
+      for (size_t v = 0; v < vars.size(); v++) {
+        if (!changed[v]) continue;
+        lose(vars[v].name);
+        for (const size_t p : prods.productionsOf(v))
+          for (const std::string &elem : prods.elements(p)) lose(elem);
+      }
+      for (size_t v = 0; v < old.vars.size(); v++) {
+        it = varIds.find(old.vars[v].name);
+        if (it != varIds.end() && !changed[it->second]) continue;
+        for (const size_t p : old.prods.productionsOf(v))
+          for (const std::string &elem : old.prods.elements(p)) lose(elem);
+      }
+      for (size_t p = 0; p < prods.size(); p++) {
+        bool dirty = false;
+        for (size_t i = prods.offset(p); i < prods.offset(p+1); i++)
+          dirty = dirty || (codes[i] < 0 && !sameFirst[-1 - codes[i]]);
+        if (dirty)
+          for (const std::string &elem : prods.elements(p)) lose(elem);
+      }
+      while (!queue.empty()) {
+        size_t v = queue.back();
+        queue.pop_back();
+        for (const size_t p : prods.productionsOf(v))
+          for (const std::string &elem : prods.elements(p)) lose(elem);
+      }
+      return true;
+    }
 
-      return follows;
+    /* Copies a set of previous with the ids of the terminals of this grammar */
+    void copyPrevious(const TermSet &from, TermSet &to) const {
+      from.forEach([&](size_t t) {
+        if (previousTerm[t] != (size_t)-1) to.insert(previousTerm[t]);
+      });
     }
 
-    bool drifts_epsilon(std::list<std::string> elements) {
-      for (const std::string elem : elements)
-        if (elem.compare(EPSILON) != 0) {
-          std::list<std::string> firsts = calcFirst(elem);
-          if (std::find(firsts.begin(), firsts.end(), EPSILON) == firsts.end())
-            return false;
+    /* Calculates FIRST of every variable. A variable needs the FIRST of the
+     * variables that can start its productions, so the grammar is split in
+     * strongly connected components of that relation and each component is
+     * solved once the ones it needs are done. Independent components run in
+     * parallel. */
+    void calcFirstSets() {
+      DependencyGraph graph(vars.size());
+      ThreadPool *pool_ = setsPool();
+
+      for (size_t p = 0; p < prods.size(); p++) {
+        size_t head = varIds[prods.variable(p)];
+        for (size_t i = prods.offset(p); i < prods.offset(p+1); i++) {
+          if (codes[i] == EPSILON_CODE) continue;
+          if (codes[i] >= 0) break;
+          graph.addEdge(head, -1 - codes[i]);
+          if (!nullable[-1 - codes[i]]) break;
         }
+      }
+      graph.split();
+
+      firstSets.assign(vars.size(),
+        TermSet(termNames.size(), counted(MemoryCategory::SETS)));
+      if (previous != NULL && calcReusable())
+        for (size_t v = 0; v < vars.size(); v++)
+          if (sameFirst[v])
+            copyPrevious(previous->firstSets[previousVar[v]], firstSets[v]);
+
+      // A component reaches the same variables from all its members
+      std::atomic<bool> stop(false);
+      graph.solve([this, &graph, &stop](size_t c) {
+        Span<size_t> members = graph.membersOf(c);
+        bool changed, empty;
+        if (!sameFirst.empty() && sameFirst[members[0]]) return;
+        do {
+          if (stop || interrupted()) { stop = true; return; }
+          changed = false;
+          for (const size_t v : members)
+            for (const size_t p : prods.productionsOf(v))
+              changed |= firstOfRest(p, prods.offset(p), firstSets[v], empty);
+        } while (changed);
+      }, pool_);
+      if (stop) throw Interrupted();
+
+      prodFirst.assign(prods.size(),
+        TermSet(termNames.size(), counted(MemoryCategory::SETS)));
+      for (size_t p = 0; p < prods.size(); p++) {
+        bool empty;
+        firstOfRest(p, prods.offset(p), prodFirst[p], empty);
+      }
+    }
+
+    /* Calculates FOLLOW of every variable. A variable needs the FOLLOW of the
+     * variables of the productions where it can be the last one, the rest
+     * comes from FIRST which is already known. Solved by components like
+     * calcFirstSets. */
+    void calcFollowSets() {
+      DependencyGraph graph(vars.size());
+      ThreadPool *pool_ = setsPool();
+      TermSet scratch(termNames.size());
+
+      for (size_t v = 0; v < vars.size(); v++)
+        for (const Occurrence &occ : prods.occurrencesOf(v)) {
+          size_t head = varIds[prods.variable(occ.prod)];
+          bool last;
+          firstOfRest(occ.prod, occ.pos + 1, scratch, last);
+          if (last && head != v) graph.addEdge(v, head);
+        }
+      graph.split();
+
+      followSets.assign(vars.size(),
+        TermSet(termNames.size(), counted(MemoryCategory::SETS)));
+      if (!prods.empty())
+        followSets[varIds[prods.variable(0)]].insert(termNames.size() - 1);
+      reused = 0;
+      for (size_t v = 0; v < sameFollow.size(); v++)
+        if (sameFollow[v]) {
+          copyPrevious(previous->followSets[previousVar[v]], followSets[v]);
+          reused += sameFirst[v];
+        }
+
+      // A member that keeps its FOLLOW only needs ones that keep it too
+      std::atomic<bool> stop(false);
+      graph.solve([this, &graph, &stop](size_t c) {
+        Span<size_t> members = graph.membersOf(c);
+        bool changed, last;
+        if (!sameFollow.empty() && sameFollow[members[0]]) return;
+        do {
+          if (stop || interrupted()) { stop = true; return; }
+          changed = false;
+          for (const size_t v : members)
+            for (const Occurrence &occ : prods.occurrencesOf(v)) {
+              changed |= firstOfRest(occ.prod, occ.pos+1, followSets[v], last);
+              if (last)
+                changed |= followSets[v].merge(
+                  followSets[varIds.at(prods.variable(occ.prod))]);
+            }
+        } while (changed);
+      }, pool_);
+      if (stop) throw Interrupted();
+    }
+
+    /* Stores the FIRST of every variable as text */
+    void storeFirst() {
+      for (size_t v = 0; v < vars.size(); v++) {
+        std::list<std::string> first;
+        firstSets[v].forEach([&](size_t t) { first.push_back(termNames[t]); });
+        if (nullable[v]) first.push_back(EPSILON);
+        first.sort();
+        vars[v].updateFirst(first, ver);
+      }
+    }
+
+    /* Stores the FOLLOW of every variable as text */
+    void storeFollow() {
+      for (size_t v = 0; v < vars.size(); v++) {
+        std::list<std::string> follow;
+        followSets[v].forEach([&](size_t t) {follow.push_back(termNames[t]);});
+        follow.sort();
+        vars[v].updateFollow(follow, ver);
+      }
+    }
+
+    /* Returns if the productions of a variable can be told apart by one
+     * terminal: their FIRST must not intersect, only one of them can derive
+     * EPSILON and if one does, the FIRST of the others must not intersect
+     * the FOLLOW of the variable. */
+    bool isLLVariable(size_t v) const {
+      TermSet seen(termNames.size());
+      size_t nullables = 0;
+
+      for (const size_t p : prods.productionsOf(v)) {
+        // First rule
+        // FIRST(prod1) intersection FIRST(prod2) must be empty.
+        if (prodFirst[p].intersects(seen)) return false;
+        seen.merge(prodFirst[p]);
+
+        // Second Rule
+        // Only one drifts to EPSILON
+        if (prodNullable[p] && ++nullables > 1) return false;
+      }
+
+      // Third Rule
+      // FIRST(prod) intersection FOLLOW(var) must be empty when another
+      // production of the variable drifts to EPSILON
+      if (nullables == 1)
+        for (const size_t p : prods.productionsOf(v))
+          if (!prodNullable[p] && prodFirst[p].intersects(followSets[v]))
+            return false;
       return true;
     }
 
-    /* Runs a calculation to see if this is LL. Ignores if it was already
-     * calculated. */
+    /* Runs a calculation to see if this is LL: every variable must be */
     bool calcIsLL() {
-      for (Variable var : vars) {
-        std::list<Production> var_prods = productions(var.name);
-        if (var_prods.size() >= 2) {
-          for (
-            auto it1 = var_prods.begin();
-            it1 != var_prods.end() && std::next(it1) != var_prods.end();
-            it1++
-          ) {
-            for (auto it2 = std::next(it1); it2 != var_prods.end(); it2++) {
-              // First rule
-              // FIRST(prod1) intersection FIRST(prod2) must be empty.
-              std::list<std::string> firstP1 = getFirst(it1->elements.front());
-              std::list<std::string> firstP2 = getFirst(it2->elements.front());
-              std::list<std::string> intersection;
-              firstP1.sort();
-              firstP2.sort();
-              std::set_intersection(
-                firstP1.begin(), firstP1.end(),
-                firstP2.begin(), firstP2.end(),
-                std::back_inserter(intersection)
-              );
-
-              if (!intersection.empty())
-                return false;
-
-              // Second Rule
-              // Only one drifts to EPSILON
-              if (drifts_epsilon(it1->elements)&&drifts_epsilon(it2->elements))
-                return false;
-
-              // Third Rule
-              // FIRST(prod1) intersection FOLLOW(var) = EPSILON &&
-              // FIRST(prod2) intersection FOLLOW(var) = EPSILON
-              var.follow.sort();
-              std::set_intersection(
-                firstP1.begin(), firstP1.end(),
-                var.follow.begin(), var.follow.end(),
-                std::back_inserter(intersection)
-              );
-              std::set_intersection(
-                firstP2.begin(), firstP2.end(),
-                var.follow.begin(), var.follow.end(),
-                std::back_inserter(intersection)
-              );
-              if (!intersection.empty())
-                return false;
-            }
-          }
-        }
+      for (size_t v = 0; v < vars.size(); v++) {
+        if ((v & 63) == 63 && interrupted()) throw Interrupted();
+        if (!isLLVariable(v)) return false;
       }
       return true;
     }
 
-    /* Runs a calculation return the row of the LL table for an specific var. */
-    std::map<std::string, Production*> calcTable(const std::string &variable) {
-      std::map<std::string, Production*> map;
-      std::string front;
-      std::list<Production> varProds;
-      std::list<Production>::iterator prodIt;
-      Variable *var = getVar(variable), *oVar;
+    /* Looks for expressions in a grammar that is not LL. Going down from the
+     * start symbol, a variable that reaches one that is not LL is read with
+     * operator precedence if its relations can be built (with the declared
+     * precedence). Otherwise it must be LL itself and its variables are
+     * visited. Every terminal that can follow an expression in the LL part
+     * must end it. Returns if every variable reached is LL or inside an
+     * expression. */
+    bool calcExpressions() {
+      std::vector<bool> conflict(vars.size(), false), seen(vars.size(), false);
+      std::vector<bool> outer(vars.size(), false);
+      std::vector<size_t> queue;
+
+      expressions.clear();
+      expressionOf.assign(vars.size(), -1);
+      if (prods.empty()) return false;
+
+      // Variables that reach one that is not LL
+      for (size_t v = 0; v < vars.size(); v++)
+        if (!isLLVariable(v)) { conflict[v] = true; queue.push_back(v); }
+      while (!queue.empty()) {
+        size_t v = queue.back();
+        queue.pop_back();
+        for (const Occurrence &occ : prods.occurrencesOf(v)) {
+          size_t head = varIds[prods.variable(occ.prod)];
+          if (!conflict[head]) { conflict[head] = true; queue.push_back(head); }
+        }
+      }
 
-      if (!isLL) throw std::runtime_error("Is not LL!");
-      else if(var == NULL) throw std::runtime_error("Could not find variable!");
-      else {
-        for(const std::string term : var->first) {
-          for (prodIt = prods.begin(); prodIt != prods.end(); prodIt++) {
-            if ((*var) == prodIt->variable) {
-              front = prodIt->elements.front();
-              if (term.compare(front) == 0 || // Same as Terminal
-              (*var != front && (oVar=getVar(front)) && oVar->hasTerm(term)) ){
-                // Other variable that has term in first
-                map.insert(std::pair<std::string, Production*>(
-                  term, &(*prodIt)));
-              }
-            }
+      queue.push_back(varIds[prods.variable(0)]);
+      seen[queue.back()] = true;
+      for (size_t k = 0; k < queue.size(); k++) {
+        const size_t v = queue[k];
+        if ((k & 63) == 63 && interrupted()) throw Interrupted();
+        if (conflict[v]) {
+          OperatorPrecedence expression = precedence;
+          if (expression.compile(prods, varIds, vars.size(), termIds,
+              termNames.size(), v)) {
+            expressionOf[v] = expressions.size();
+            expressions.push_back(std::move(expression));
+            continue;
           }
         }
+        if (!isLLVariable(v)) return false;
+        outer[v] = true;
+        for (const size_t p : prods.productionsOf(v))
+          for (size_t i = prods.offset(p); i < prods.offset(p+1); i++)
+            if (codes[i] < 0 && !seen[-1 - codes[i]]) {
+              seen[-1 - codes[i]] = true;
+              queue.push_back(-1 - codes[i]);
+            }
+      }
+
+      // What follows an expression inside another one does not matter
+      for (size_t v = 0; v < vars.size(); v++) {
+        if (expressionOf[v] < 0) continue;
+        TermSet follow(termNames.size());
+        bool last, ends = true;
+        for (const Occurrence &occ : prods.occurrencesOf(v)) {
+          size_t head = varIds[prods.variable(occ.prod)];
+          if (!outer[head]) continue;
+          firstOfRest(occ.prod, occ.pos + 1, follow, last);
+          if (last) follow.merge(followSets[head]);
+        }
+        follow.forEach([&](size_t t) {
+          ends = ends && expressions[expressionOf[v]].endsBefore(t);
+        });
+        if (!ends) return false;
+      }
+      return !expressions.empty();
+    }
+
+    /* Row of the LL table of a variable as text, like ", MAP={'t': prod}",
+     * with the production for EPSILON under its name */
+    std::string rowString(size_t v) {
+      std::map<std::string, size_t> cells;
+      std::string str = ", MAP={";
+
+      for (size_t t = 0; t + 1 < termNames.size(); t++)
+        if (llTable.get(v, t) >= 0) cells[termNames[t]] = llTable.get(v, t);
+      if (nullProd[v] >= 0) cells[EPSILON] = nullProd[v];
+      for (const std::pair<const std::string, size_t> &cell : cells) {
+        str.append("'"); str.append(cell.first); str.append("': ");
+        str.append(prods[cell.second].toString()); str.append(", ");
+      }
+      if (!cells.empty()) { str.pop_back(); str.pop_back(); }
+      str.append("}");
+      return str;
+    }
+
+    /* Builds the LL table indexed by ids, the only copy of it. A variable
+     * with no production for the lookahead drifts to EPSILON with nullProd.
+     * Rows are stored sparse, most of them are empty or one production. */
+    void calcLLTable() {
+      const size_t nterms = termNames.size();
+      std::vector<int> row(nterms);
+
+      llTable.clear(nterms);
+      nullProd.assign(vars.size(), -1);
+      for (size_t v = 0; v < vars.size(); v++) {
+        // Stopped like before the table was started, without half its rows
+        if ((v & 63) == 63 && interrupted()) {
+          llTable.clear();
+          nullProd.clear();
+          throw Interrupted();
+        }
+        std::fill(row.begin(), row.end(), -1);
+        for (const size_t p : prods.productionsOf(v)) {
+          prodFirst[p].forEach([&](size_t t) {
+            if (row[t] == -1) row[t] = p;
+          });
+          if (prodNullable[p] && nullProd[v] == -1) nullProd[v] = p;
+        }
+        llTable.addRow(row.data());
+      }
+    }
+
+    /* Returns the id of the terminal of a word or -1 if it is not a terminal
+     * of the grammar. "$" is not accepted as a word. */
+    int terminalId(const std::string &word) const {
+      return terminalId(word.data(), word.size());
+    }
+
+    int terminalId(const char *word, size_t len) const {
+      int t = termHash.find(word, len);
+      return (t + 1 == (int)termNames.size())? -1 : t;
+    }
+
+    /* Predictive stack before reading the first terminal (top is the back) */
+    std::vector<int> startStack() const {
+      std::vector<int> stack;
+      if (!prods.empty())
+        stack.push_back(-1 - (int)varIds.at(prods.variable(0)));
+      return stack;
+    }
+
+    /* Moves the predictive stack (built with startStack) over the terminal
+     * with the received id, or over the end of the string if term is the id
+     * of "$". Returns false if the terminal can not come next. It is the same
+     * loop as testStr over ids, meant to be called once per terminal. */
+    bool step(std::vector<int> &stack, int term) const {
+      return step(stack, term, [](size_t, int) {});
+    }
+
+    /* Same as step, calling expand(variable, production) after every
+     * expansion of a variable. It is a template so the call costs nothing
+     * when expand does nothing. */
+    template <typename Expand>
+    bool step(std::vector<int> &stack, int term, Expand expand) const {
+      const size_t nterms = termNames.size();
+      const int end = nterms - 1;
+
+      while (!stack.empty()) {
+        int top = stack.back();
+        stack.pop_back();
+
+        // Same term
+        if (top >= 0) return top == term;
+
+        size_t v = -1 - top;
+        int p = (term >= 0)? llTable.get(v, term) : -1;
+        if (p == -1) {
+          // No production for term, the variable must drift to EPSILON
+          if (nullProd[v] == -1) return false;
+          expand(v, nullProd[v]);
+          continue;
+        }
+        for (size_t i = prods.offset(p+1); i-- > prods.offset(p);)
+          if (codes[i] != EPSILON_CODE) stack.push_back(codes[i]);
+        expand(v, p);
       }
-      return map;
+      return term == end;
+    }
+
+    /* Same as testStr over terminal ids, without the trace. Words are
+     * separated by Unicode whitespace like in splitWords. */
+    bool testIds(const std::string &str) const {
+      std::vector<int> stack = startStack();
+
+      if (prods.empty()) return false;
+      return Utf8::forEachWord(str.data(), str.size(),
+        [&](const char *word, size_t len) {
+          int term = terminalId(word, len);
+          return term >= 0 && step(stack, term);
+        }) && step(stack, termNames.size() - 1);
     }
 
     /* Test if the string is valid. */
     bool testStr(std::string str) {
       std::string term, top;
       std::stack<std::string> stack;
-      std::list<std::string> pels;
-      std::list<std::string>::reverse_iterator rit;
+      Span<std::string> pels;
       Variable *v;
-      Production* prod;
+      int p;
       size_t pos;
 
-      sprintf(LABUFFER, "\nTesting string '%s'", str.c_str()); log(LABUFFER);
+      snprintf(LABUFFER, sizeof(LABUFFER), "\nTesting string '%s'", str.c_str());
+      log(LABUFFER);
 
-      str.append(" $ ");
+      str.append((str.empty())? "$ " : " $ ");
 
       if (!prods.empty()) {
         stack.push("$");
-        stack.push(prods.front().variable);
+        stack.push(prods.variable(0));
         while ((pos = str.find(' ')) != std::string::npos) {
           term = str.substr(0, pos);
 
@@ -408,7 +831,8 @@ class LexicalAnalyzer {
           top = stack.top();
 
           if (logging) {
-            sprintf(LABUFFER, "\n%s\t|\t%s", top.c_str(), str.c_str());
+            snprintf(LABUFFER, sizeof(LABUFFER), "\n%s\t|\t%s", top.c_str(),
+              str.c_str());
             log(LABUFFER);
           }
 
@@ -424,14 +848,18 @@ class LexicalAnalyzer {
             }
           // No terminal that can get to term
           } else if( (v=getVar(top)) && v->hasTerm(term)) {
+            // '' is in FIRST of a nullable variable but it is not a word
+            int t = terminalId(term);
+            if (!isLL || t < 0 || (p = llTable.get(varIds[top], t)) < 0) break;
             if(logging) {
-              sprintf(LABUFFER, "\t|\t%s", v->table[term]->toString().c_str());
+              snprintf(LABUFFER, sizeof(LABUFFER), "\t|\t%s",
+                prods[p].toString().c_str());
               log(LABUFFER);
             }
             stack.pop();
 
-            pels = v->table[term]->elements;
-            for(rit=pels.rbegin(); rit!=pels.rend(); rit++) stack.push(*rit);
+            pels = prods.elements(p);
+            for (size_t i = pels.size(); i-- > 0;) stack.push(pels[i]);
           // No terminal that can be epsilon
           } else if(v && v->hasTerm(EPSILON)) {
             if (logging) log("\t|\tEPSILON");
@@ -446,33 +874,436 @@ class LexicalAnalyzer {
       return false;
     }
 
-    /* Updates the Variables and if it is LL so we do not need to calculate 
-     * so many first, follow, is_ll, and LLTable */
-    void update() {
+    /* Test if the string is valid with the Earley recognizer. It works for any
+     * grammar, so it is used when there is no LL table. */
+    bool testEarley(const std::string &str) {
+      snprintf(LABUFFER, sizeof(LABUFFER), "\nTesting string '%s' with Earley\n",
+        str.c_str());
+      log(LABUFFER);
+
+      if (earleyVer != ver) {
+        earley.compile(prods, varIds, vars.size());
+        earleyVer = ver;
+      }
+
+      if (earley.recognize(splitWords(str))) return true;
+      log("ERROR\n");
+      return false;
+    }
+
+    /* Test if the string is valid with the DFA of a regular grammar. Words
+     * are separated by Unicode whitespace like in splitWords. */
+    bool testAutomaton(const std::string &str) const {
+      int state = automaton.initial();
+
+      return state >= 0 && Utf8::forEachWord(str.data(), str.size(),
+        [&](const char *word, size_t len) {
+          int term = terminalId(word, len);
+          state = (term < 0)? -1 : automaton.next(state, term);
+          return state >= 0;
+        }) && automaton.isFinal(state);
+    }
+
+    /* Test if the string is valid with the operator precedence relations */
+    bool testPrecedence(const std::string &str) {
+      std::vector<int> ids;
+
+      snprintf(LABUFFER, sizeof(LABUFFER),
+        "\nTesting string '%s' with operator precedence\n", str.c_str());
+      log(LABUFFER);
+
+      for (const std::string &word : splitWords(str))
+        ids.push_back(terminalId(word));
+      if (precedence.recognize(ids)) return true;
+      log("ERROR\n");
+      return false;
+    }
+
+    /* Test if the terminals are valid with the LL table, reading every
+     * expression with its operator precedence relations */
+    bool recognizeMixed(const std::vector<int> &ids) const {
+      const int end = termNames.size() - 1;
+      std::vector<int> stack = startStack();
+      size_t i = 0;
+
+      while (!stack.empty()) {
+        int top = stack.back(), term = (i < ids.size())? ids[i] : end;
+        stack.pop_back();
+        if (term < 0) return false;
+
+        // Same term
+        if (top >= 0) {
+          if (top != term) return false;
+          i++;
+          continue;
+        }
+
+        size_t v = -1 - top;
+        if (expressionOf[v] >= 0) {
+          if (!expressions[expressionOf[v]].recognizePrefix(ids, i))
+            return false;
+          continue;
+        }
+        int p = llTable.get(v, term);
+        if (p == -1) p = nullProd[v];
+        if (p == -1) return false;
+        for (size_t k = prods.offset(p+1); k-- > prods.offset(p);)
+          if (codes[k] != EPSILON_CODE) stack.push_back(codes[k]);
+      }
+      return !prods.empty() && i == ids.size();
+    }
+
+    /* Test if the string is valid with the LL table and the operator
+     * precedence relations of its expressions */
+    bool testMixed(const std::string &str) {
+      snprintf(LABUFFER, sizeof(LABUFFER),
+        "\nTesting string '%s' with LL and operator precedence\n",
+        str.c_str());
+      log(LABUFFER);
+
+      if (recognizeMixed(wordIds(str))) return true;
+      log("ERROR\n");
+      return false;
+    }
+
+    /* Starts counting again for the current grammar */
+    void newProfile() {
+      std::vector<std::string> prodNames, varNames;
+      for (size_t p = 0; p < prods.size(); p++)
+        prodNames.push_back(prods[p].toString());
+      for (const Variable &var : vars) varNames.push_back(var.name);
+      profile.reset(new RecognitionProfile(prodNames, varNames,
+        std::vector<std::string>(termNames.begin(), termNames.end())));
+    }
+
+    /* Recognizes the string and counts it in the profile. LL grammars go
+     * through the predictive table, even if they are regular, so every
+     * expansion is counted; the rest only count words and results. */
+    bool profileStr(const std::string &str) const {
+      RecognitionProfile::Counters &counters = profile->local();
+      const size_t nterms = termNames.size();
+      std::vector<int> stack = startStack();
+      size_t words = 0, depth = stack.size();
+      bool valid = !prods.empty();
+      int term = -1;
+
+      if (!isLL) {
+        std::vector<int> ids = wordIds(str);
+        valid = recognizeIds(ids, str).valid;
+        counters.sentence(valid, ids.size(), 0);
+        return valid;
+      }
+
+      auto expand = [&](size_t v, int p) {
+        counters.expand(p, v * nterms + term);
+        depth = std::max(depth, stack.size());
+      };
+      Utf8::forEachWord(str.data(), str.size(),
+        [&](const char *word, size_t len) {
+          words++;
+          if (valid) {
+            term = terminalId(word, len);
+            valid = term >= 0 && step(stack, term, expand);
+          }
+          return true;
+        });
+      term = nterms - 1;
+      valid = valid && step(stack, term, expand);
+      counters.sentence(valid, words, depth);
+      return valid;
+    }
+
+    /* Terminal id of every word of the string, -1 for the unknown ones */
+    std::vector<int> wordIds(const std::string &str) const {
+      std::vector<int> ids;
+      Utf8::forEachWord(str.data(), str.size(),
+        [&](const char *word, size_t len) {
+          ids.push_back(terminalId(word, len));
+          return true;
+        });
+      return ids;
+    }
+
+    /* Recognizes the words of str, given also as ids. A rejected string of a
+     * regular or LL grammar gets the word where it stopped and the terminals
+     * that could have been there, the other recognizers only tell if it was
+     * accepted. Earley must have been compiled. */
+    CachedResult recognizeIds(const std::vector<int> &ids,
+      const std::string &str) const {
+      CachedResult result{false, RESULT_NO_POSITION, {}};
+      const int end = termNames.size() - 1;
+      size_t i = 0;
+
+      if (isRegular) {
+        int state = automaton.initial();
+        for (; i < ids.size() && ids[i] >= 0; i++) {
+          if (automaton.next(state, ids[i]) < 0) break;
+          state = automaton.next(state, ids[i]);
+        }
+        if ((result.valid = i == ids.size() && automaton.isFinal(state)))
+          return result;
+        result.position = i;
+        for (int t = 0; t < end; t++)
+          if (automaton.next(state, t) >= 0) result.expected.push_back(t);
+        if (automaton.isFinal(state)) result.expected.push_back(end);
+      } else if (isLL) {
+        std::vector<int> stack = startStack(), copy;
+        if (prods.empty()) return result;
+        for (; i <= ids.size(); i++)
+          if (!step(stack, (i < ids.size())? ids[i] : end)) break;
+        if ((result.valid = i > ids.size())) return result;
+
+        // Stack before the word that failed, only rebuilt when rejected
+        stack = startStack();
+        for (size_t j = 0; j < i; j++) step(stack, ids[j]);
+        result.position = i;
+        for (int t = 0; t <= end; t++) {
+          copy = stack;
+          if (step(copy, t)) result.expected.push_back(t);
+        }
+      } else if (isOP) {
+        result.valid = precedence.recognize(ids);
+      } else if (isMixed) {
+        result.valid = recognizeMixed(ids);
+      } else {
+        result.valid = earley.recognize(splitWords(str));
+      }
+      return result;
+    }
+
+    /* Throws if the grammar needs Earley and prepare was not called after
+     * the last update */
+    void checkPrepared() const {
+      if (!isRegular && !isLL && !isOP && !isMixed && earleyVer != ver) {
+        fprintf(stderr, "The analyzer was not prepared!\n");
+        throw std::runtime_error("Not prepared!");
+      }
+    }
+
+    /* Result of a valid UTF-8 string, from the cache if there is one */
+    CachedResult cachedResult(const std::string &str) const {
+      std::vector<int> ids = wordIds(str);
+      CachedResult result;
+
+      if (!results) return recognizeIds(ids, str);
+      const uint64_t key = ResultCache::hash(ids, ver);
+      if (results->find(key, ids, ver, result)) return result;
+      result = recognizeIds(ids, str);
+      results->insert(key, ids, ver, result);
+      return result;
+    }
+
+    /* Starts a new version: drops the results of the last analysis, indexes
+     * the productions and gives ids to the symbols */
+    void calcVersion() {
       ver++;
       sprintf(LABUFFER, "\nUpdating to version %i...\n", ver); log(LABUFFER);
-      isLL = calcIsLL();
-      (isLL)? log("It's LL\n") : log("It is not LL\n");
-      for (auto it = vars.begin(); it != vars.end(); it++) {
-        if(it->firVer != ver) it->updateFirst(calcFirst(it->name), ver);
-        if(it->folVer != ver) it->updateFollow(calcFollow(it->name), ver);
-        if(isLL) it->table = calcTable(it->name);
-        sprintf(LABUFFER, "%s\n", it->toString().c_str()); log(LABUFFER);
+      isLL = false;
+      isOP = false;
+      isMixed = false;
+      isRegular = false;
+      expressions.clear();
+      expressionOf.clear();
+      for (Variable &var : vars) {
+        var.first.clear(); var.follow.clear();
+      }
+      llTable.clear();
+      nullProd.clear();
+      if (results)
+        results.reset(new ResultCache(results->getCapacity(),
+          results->getShards()));
+      prods.index(varIds, vars.size());
+      calcSymbols();
+      if (profile) newProfile();
+    }
+
+    /* Builds the tables of the recognizers that fit the grammar */
+    void calcTables() {
+      isOP = !isLL && precedence.compile(prods, varIds, vars.size(), termIds,
+        termNames.size());
+      if (isOP) log("It's operator precedence\n");
+      isRegular = automaton.compile(prods, varIds, vars.size(), termIds,
+        termNames.size(), control);
+      if (!isRegular && interrupted()) throw Interrupted();
+      if (isRegular) log("It's regular\n");
+      isMixed = !isLL && !isOP && !isRegular && calcExpressions();
+      if (isMixed) log("It's LL with operator precedence expressions\n");
+      else { expressions.clear(); expressionOf.clear(); }
+      if (isLL || isMixed) calcLLTable();
+      for (size_t v = 0; v < vars.size() && logging; v++) {
+        log(vars[v].toString().c_str());
+        if (isLL) log(rowString(v).c_str());
+        log("\n");
       }
     }
 
+    void runPhase(AnalysisPhase step) {
+      switch (step) {
+        case AnalysisPhase::SYMBOLS: calcVersion(); break;
+        case AnalysisPhase::NULLABLE: calcNullable(); break;
+        case AnalysisPhase::FIRST: calcFirstSets(); storeFirst(); break;
+        case AnalysisPhase::FOLLOW: calcFollowSets(); storeFollow(); break;
+        case AnalysisPhase::LL_CHECK:
+          isLL = calcIsLL();
+          (isLL)? log("It's LL\n") : log("It is not LL\n");
+          break;
+        case AnalysisPhase::TABLE: calcTables(); break;
+        case AnalysisPhase::DONE: break;
+      }
+    }
+
+    /* Runs the phases of the analysis from the first one that is not done.
+     * The symbols are always collected, the control is checked before every
+     * other phase and inside the long ones. A stopped phase runs again from
+     * its start on the next call, the ones before it keep their results. */
+    AnalysisStatus runAnalysis(const AnalysisControl &control_) {
+      AnalysisStatus status = AnalysisStatus::DONE;
+
+      control = &control_;
+      try {
+        while (phase != AnalysisPhase::DONE) {
+          AnalysisPhase step = phase;
+          if (step != AnalysisPhase::SYMBOLS && interrupted())
+            throw Interrupted();
+          runPhase(step);
+          phase = (AnalysisPhase)((int)step + 1);
+          if (control_.progress)
+            control_.progress(step, (size_t)phase, ANALYSIS_PHASES);
+        }
+      } catch (const Interrupted &) {
+        status = (control_.cancelled())?
+          AnalysisStatus::CANCELLED : AnalysisStatus::TIMED_OUT;
+        log("Analysis stopped\n");
+      } catch (const MemoryBudgetError &) {
+        control = NULL;
+        releaseAnalysis();
+        budgetExceeded("update");
+      }
+      control = NULL;
+      return status;
+    }
+
+    /* Runs the whole analysis of the grammar again */
+    void update() {
+      phase = AnalysisPhase::SYMBOLS;
+      runAnalysis(AnalysisControl());
+    }
+
+    /* Reports that an allocation did not fit in the memory budget */
+    void budgetExceeded(const char *step) {
+      fprintf(stderr, "Memory budget of %zu bytes exceeded on %s!\n",
+        memory->getBudget(), step);
+      throw std::runtime_error("Memory budget exceeded!");
+    }
+
+    /* Frees everything calculated by update, so a failed update leaves the
+     * analyzer with its grammar and no analysis. */
+    void releaseAnalysis() {
+      phase = AnalysisPhase::SYMBOLS;
+      isLL = false;
+      isOP = false;
+      isMixed = false;
+      isRegular = false;
+      expressions.clear();
+      expressionOf.clear();
+      for (Variable &var : vars) {
+        var.first.clear(); var.follow.clear();
+      }
+      CountedVector<std::string>(termNames.get_allocator()).swap(termNames);
+      termIds.clear();
+      termHash.build(Span<std::string>());
+      CountedVector<int>(codes.get_allocator()).swap(codes);
+      CountedVector<bool>(nullable.get_allocator()).swap(nullable);
+      CountedVector<bool>(prodNullable.get_allocator()).swap(prodNullable);
+      CountedVector<TermSet>(firstSets.get_allocator()).swap(firstSets);
+      CountedVector<TermSet>(followSets.get_allocator()).swap(followSets);
+      CountedVector<TermSet>(prodFirst.get_allocator()).swap(prodFirst);
+      llTable.clear();
+      CountedVector<int>(nullProd.get_allocator()).swap(nullProd);
+    }
+
+    /* Finds the variables that derive a string of terminals. Like
+     * calcNullable, every production counts the variables of its right hand
+     * side that are not known to be productive. */
+    std::vector<bool> calcProductive() {
+      std::vector<size_t> missing(prods.size(), 0), queue;
+      std::vector<bool> productive(vars.size(), false);
+
+      for (size_t p = 0; p < prods.size(); p++) {
+        for (size_t i = prods.offset(p); i < prods.offset(p+1); i++)
+          if (codes[i] < 0) missing[p]++;
+        if (missing[p] == 0) queue.push_back(p);
+      }
+
+      while (!queue.empty()) {
+        size_t v = varIds[prods.variable(queue.back())];
+        queue.pop_back();
+        if (productive[v]) continue;
+        productive[v] = true;
+        for (const Occurrence &occ : prods.occurrencesOf(v))
+          if (--missing[occ.prod] == 0) queue.push_back(occ.prod);
+      }
+      return productive;
+    }
+
+    /* Finds the variables reached from the start symbol through productions
+     * whose variables are all productive */
+    std::vector<bool> calcReachable(const std::vector<bool> &productive) {
+      std::vector<bool> reachable(vars.size(), false);
+      std::vector<size_t> queue;
+
+      if (prods.empty()) return reachable;
+      queue.push_back(varIds[prods.variable(0)]);
+      reachable[queue.back()] = true;
+      while (!queue.empty()) {
+        size_t v = queue.back();
+        queue.pop_back();
+        for (size_t p : prods.productionsOf(v)) {
+          bool useful = true;
+          for (size_t i = prods.offset(p); i < prods.offset(p+1); i++)
+            if (codes[i] < 0 && !productive[-1 - codes[i]]) useful = false;
+          if (!useful) continue;
+          for (size_t i = prods.offset(p); i < prods.offset(p+1); i++)
+            if (codes[i] < 0 && !reachable[-1 - codes[i]]) {
+              reachable[-1 - codes[i]] = true;
+              queue.push_back(-1 - codes[i]);
+            }
+        }
+      }
+      return reachable;
+    }
+
   public:
-    LexicalAnalyzer() { isLL = false; ver = 1; logFile = NULL; logging = false; }
+    LexicalAnalyzer() {
+      isLL = false; isOP = false; isRegular = false; isMixed = false; ver = 1;
+      earleyVer = -1;
+      logFile = NULL; logging = false; phase = AnalysisPhase::SYMBOLS;
+      control = NULL; nthreads = std::thread::hardware_concurrency();
+      previous = NULL; reused = 0; }
 
     LexicalAnalyzer(FILE *logFile_): logFile(logFile_) {
-      isLL=false; ver=0; logging = true; }
+      isLL=false; isOP=false; isRegular=false; isMixed=false; ver=0;
+      earleyVer = -1;
+      logging = true; phase = AnalysisPhase::SYMBOLS; control = NULL;
+      nthreads = std::thread::hardware_concurrency();
+      previous = NULL; reused = 0; }
+
+    /* Sets how many threads solve FIRST and FOLLOW on grammars with at least
+     * PARALLEL_MIN_VARS variables. 1 solves them in this thread. */
+    void setThreads(size_t n) { nthreads = n; }
 
     void clear() {
       log("\nClearing lexical analyzer...\n");
       log("==============================================================\n\n");
       vars.clear();
+      varIds.clear();
       terms.clear();
       prods.clear();
+      originalProds.clear();
+      prodOrigins.clear();
+      precedence.clear();
+      earleyVer = -1;
+      phase = AnalysisPhase::SYMBOLS;
     }
 
     /* Parses a given list of productions. If the sintax is valid it returns
@@ -487,44 +1318,71 @@ class LexicalAnalyzer {
       return all;
     }
 
+    /* Splits a string in the words separated by Unicode whitespace */
+    static std::vector<std::string> splitWords(const std::string &str) {
+      std::vector<std::string> words;
+      Utf8::forEachWord(str.data(), str.size(),
+        [&](const char *word, size_t len) {
+          words.push_back(std::string(word, len));
+          return true;
+        });
+      return words;
+    }
+
+    /* Splits a production in its variable and its elements. Returns false if
+     * it is not valid UTF-8 or not like "Variable -> elements". Words are
+     * separated by Unicode whitespace and the variable is made of letters,
+     * '_', '-' and characters out of ASCII. "$" marks the end of the input,
+     * so it is not a valid element. */
+    static bool splitRule(const std::string &rule, std::string &variable,
+      std::vector<std::string> &elements) {
+      if (!Utf8::valid(rule.data(), rule.size())) return false;
+
+      std::vector<std::string> words = splitWords(rule);
+      if (words.size() < 3 || words[1].compare("->") != 0) return false;
+      for (const unsigned char c : words[0])
+        if (c < 0x80 && !(c >= 'A' && c <= 'Z') && !(c >= 'a' && c <= 'z') &&
+            c != '_' && c != '-') return false;
+
+      for (size_t i = 2; i < words.size(); i++)
+        if (words[i].compare("$") == 0) return false;
+
+      variable = words[0];
+      elements.assign(words.begin() + 2, words.end());
+      return true;
+    }
+
     /* Parses a given production. If the sintax is valid it returns true, if
      * not it returns false */
     bool parse(std::string production, bool runUpdate = true) {
-      std::regex productionRegex(RULEREGEX);
-      std::string variable, terminal, *strptr;
-      char *cptr;
-      size_t pos;
-
-      // Does not match regex
-      if (!std::regex_match(production, productionRegex)) return false;
-
-      sprintf(LABUFFER, "Parsing %s\n", production.c_str()); log(LABUFFER);
-
-      // Find the divider between variable and terminals
-      pos = production.find(" -> ");
-
-      // Get variable and add it to list if not found
-      variable = production.substr(0, pos);
-      if (!hasVar(variable)) vars.push_back(Variable(variable));
-      Production prod = Production(variable);
-
-      // Remove variable from terminal list if it was inside
-      terms.remove(variable);
-
-      // Erase no terminal to only leave rule
-      production.erase(0, pos+4);
+      std::string variable;
+      std::vector<std::string> elements;
+
+      // Not a production
+      if (!splitRule(production, variable, elements)) return false;
+
+      snprintf(LABUFFER, sizeof(LABUFFER), "Parsing %s\n", production.c_str());
+      log(LABUFFER);
+
+      // Stored first so a production over the memory budget changes nothing
+      try {
+        prods.add(variable, elements);
+      } catch (const MemoryBudgetError &) { budgetExceeded("parse"); }
+      if (!prodOrigins.empty()) {
+        originalProds.push_back(prods[prods.size() - 1].toString());
+        prodOrigins.push_back(ProdOrigin{{originalProds.size() - 1},
+          std::vector<size_t>(elements.size(), 1)});
+      }
 
-      // Iterate through words in the production
-      while ((pos = production.find(' ')) != std::string::npos) {
-        terminal = production.substr(0, pos);
-        if(!hasVar(terminal)) terms.push_back(terminal);
-        prod.elements.push_back(terminal);
-        production.erase(0, pos+1);
+      // Add variable to list if not found and remove it from terminal list
+      if (!hasVar(variable)) {
+        varIds[variable] = vars.size();
+        vars.push_back(Variable(variable, memory.get()));
       }
-      if(!hasVar(production)) terms.push_back(production); // last word
-      prod.elements.push_back(production);
+      terms.remove(variable);
 
-      prods.push_back(prod);
+      for (const std::string &elem : elements)
+        if (!hasVar(elem)) terms.push_back(elem);
       terms.remove(EPSILON);
       terms.sort();
       terms.unique();
@@ -542,18 +1400,447 @@ class LexicalAnalyzer {
         log("}\n");
       }
 
+      phase = AnalysisPhase::SYMBOLS;
       if(runUpdate) update();
       return true;
     }
 
-    bool validStr(const std::string &str) { return testStr(str); }
+    /* Removes the variables that derive no string or can not be reached
+     * from the start symbol, with every production that uses them and the
+     * terminals that are left unused, and then updates. Parse the rules with
+     * runUpdate set to false so FIRST, FOLLOW and the table are only
+     * calculated for the clean grammar. If the start symbol derives no string
+     * the grammar is kept as it is. Returns what was removed. */
+    GrammarCleanup cleanup() {
+      GrammarCleanup report;
+      std::vector<bool> productive, reachable, keepVar, keepProd;
+      std::list<std::string> kept;
+
+      log("\nCleaning grammar...\n");
+      try {
+        prods.index(varIds, vars.size());
+        calcSymbols();
+        calcNullable();
+      } catch (const MemoryBudgetError &) {
+        releaseAnalysis();
+        budgetExceeded("cleanup");
+      }
+      productive = calcProductive();
+      reachable = calcReachable(productive);
+
+      report.empty = prods.empty() || !productive[varIds[prods.variable(0)]];
+      if (report.empty) { update(); return report; }
+
+      keepVar.assign(vars.size(), false);
+      for (size_t v = 0; v < vars.size(); v++) {
+        keepVar[v] = productive[v] && reachable[v];
+        if (!productive[v]) report.unproductive.push_back(vars[v].name);
+        else if (!reachable[v]) report.unreachable.push_back(vars[v].name);
+        else if (nullable[v]) report.nullable.push_back(vars[v].name);
+      }
+
+      keepProd.assign(prods.size(), true);
+      for (size_t p = 0; p < prods.size(); p++) {
+        keepProd[p] = keepVar[varIds[prods.variable(p)]];
+        for (size_t i = prods.offset(p); i < prods.offset(p+1); i++)
+          if (codes[i] < 0 && !keepVar[-1 - codes[i]]) keepProd[p] = false;
+        if (!keepProd[p]) report.productions.push_back(prods[p].toString());
+      }
+
+      // Rebuild the grammar with what is left, in the same order. The new set
+      // is charged too, so moving it into prods can not go over the budget.
+      ProductionSet clean(memory.get());
+      std::vector<Variable> cleanVars;
+      std::map<std::string, size_t> cleanIds;
+      std::vector<ProdOrigin> cleanOrigins;
+      for (size_t v = 0; v < vars.size(); v++)
+        if (keepVar[v]) {
+          cleanIds[vars[v].name] = cleanVars.size();
+          cleanVars.push_back(Variable(vars[v].name, memory.get()));
+        }
+      // The start symbol keeps the first production even if that was removed
+      std::vector<size_t> order;
+      for (const size_t p : prods.productionsOf(varIds[prods.variable(0)]))
+        if (keepProd[p]) { order.push_back(p); break; }
+      for (size_t p = 0; p < prods.size(); p++)
+        if (keepProd[p] && p != order[0]) order.push_back(p);
+      for (const size_t p : order) {
+        Span<std::string> elements = prods.elements(p);
+        try {
+          clean.add(prods.variable(p),
+            std::vector<std::string>(elements.begin(), elements.end()));
+        } catch (const MemoryBudgetError &) { budgetExceeded("cleanup"); }
+        if (!prodOrigins.empty()) cleanOrigins.push_back(prodOrigins[p]);
+        for (size_t i = prods.offset(p); i < prods.offset(p+1); i++)
+          if (codes[i] >= 0 && codes[i] != EPSILON_CODE)
+            kept.push_back(prods.element(i));
+      }
+      kept.sort();
+      kept.unique();
+      std::set_difference(terms.begin(), terms.end(), kept.begin(), kept.end(),
+        std::back_inserter(report.terminals));
+
+      if (logging)
+        for (const std::string &prod : report.productions) {
+          log("Removed "); log(prod.c_str()); log("\n");
+        }
+
+      prods = std::move(clean);
+      vars = std::move(cleanVars);
+      varIds = std::move(cleanIds);
+      terms = std::move(kept);
+      prodOrigins = std::move(cleanOrigins);
+      earleyVer = -1;
+      update();
+      return report;
+    }
+
+    /* Replaces the unit productions (A -> B) by what their variable derives
+     * and the variables with one production used once by that production,
+     * keeping only what the start symbol reaches, and then updates. The
+     * language is the same, but the predictive parser does not go through
+     * the chains: goal -> A, A -> two, two -> a becomes goal -> a. Use
+     * getOriginalProds to tell what a new production stands for. */
+    GrammarChains collapseChains() {
+      GrammarChains report{0, 0, {}};
+      std::vector<ChainRule> rules;
+      std::vector<bool> keepVar(vars.size(), false);
+      std::list<std::string> kept;
+
+      log("\nCollapsing chains...\n");
+      if (prods.empty()) return report;
+      prods.index(varIds, vars.size());
+      if (prodOrigins.empty())
+        for (size_t p = 0; p < prods.size(); p++) {
+          originalProds.push_back(prods[p].toString());
+          prodOrigins.push_back(ProdOrigin{{p},
+            std::vector<size_t>(prods.elements(p).size(), 1)});
+        }
+      ChainCollapse collapse(prods, varIds, prodOrigins);
+      rules = collapse.run();
+      report.units = collapse.nunits;
+      report.inlined = collapse.ninlined;
+
+      // Rebuild the grammar like cleanup, variables keep their order
+      ProductionSet collapsed(memory.get());
+      std::vector<Variable> keptVars;
+      std::map<std::string, size_t> keptIds;
+      std::vector<ProdOrigin> keptOrigins;
+      for (const ChainRule &rule : rules) keepVar[rule.head] = true;
+      for (size_t v = 0; v < vars.size(); v++) {
+        if (!keepVar[v]) { report.removed.push_back(vars[v].name); continue; }
+        keptIds[vars[v].name] = keptVars.size();
+        keptVars.push_back(Variable(vars[v].name, memory.get()));
+      }
+      for (ChainRule &rule : rules) {
+        try {
+          collapsed.add(vars[rule.head].name, rule.body);
+        } catch (const MemoryBudgetError &) {
+          budgetExceeded("collapseChains");
+        }
+        for (const std::string &elem : rule.body)
+          if (!hasVar(elem) && elem.compare(EPSILON) != 0)
+            kept.push_back(elem);
+        keptOrigins.push_back(std::move(rule.origin));
+      }
+      kept.sort();
+      kept.unique();
+
+      if (logging) {
+        snprintf(LABUFFER, sizeof(LABUFFER),
+          "Replaced %zu units and %zu variables, %zu productions left\n",
+          report.units, report.inlined, rules.size());
+        log(LABUFFER);
+      }
+
+      prods = std::move(collapsed);
+      vars = std::move(keptVars);
+      varIds = std::move(keptIds);
+      terms = std::move(kept);
+      prodOrigins = std::move(keptOrigins);
+      earleyVer = -1;
+      update();
+      return report;
+    }
+
+    /* Productions of the grammar before collapseChains that the production
+     * with the received id stands for, in the order a leftmost derivation
+     * applies them. Without collapseChains it is the production itself. */
+    std::list<std::string> getOriginalProds(size_t prod) const {
+      std::list<std::string> origin;
+      if (prod >= prods.size()) return origin;
+      if (prodOrigins.empty()) origin.push_back(prods[prod].toString());
+      else
+        for (const size_t p : prodOrigins[prod].prods)
+          origin.push_back(originalProds[p]);
+      return origin;
+    }
+
+    /* Returns if the string belongs to the language of the grammar. Regular
+     * grammars use their DFA, LL grammars the predictive table, operator
+     * precedence grammars the precedence relations, LL grammars with
+     * operator precedence expressions both and the rest use Earley. */
+    bool validStr(const std::string &str) {
+      if (!Utf8::valid(str.data(), str.size())) {
+        log("\nThe string is not valid UTF-8\n");
+        return false;
+      }
+      // The cache and the profile are skipped while logging so every string
+      // gets its trace
+      if (profile && !logging) {
+        prepare();
+        return profileStr(str);
+      }
+      if (results && !logging) {
+        prepare();
+        return cachedResult(str).valid;
+      }
+      if (isRegular) {
+        if (!logging) return testAutomaton(str);
+        snprintf(LABUFFER, sizeof(LABUFFER),
+          "\nTesting string '%s' with the DFA\n", str.c_str());
+        log(LABUFFER);
+        if (testAutomaton(str)) return true;
+        log("ERROR\n");
+        return false;
+      }
+      if (isLL && !logging) return testIds(str);
+      if (isLL) {
+        // The trace of testStr reads words separated by one space
+        std::string words;
+        for (const std::string &word : splitWords(str)) {
+          words.append(word);
+          words.push_back(' ');
+        }
+        if (!words.empty()) words.pop_back();
+        return testStr(words);
+      }
+      if (isOP) return testPrecedence(str);
+      return (isMixed)? testMixed(str) : testEarley(str);
+    }
+
+    /* Compiles whatever validStr needs that is built on first use, so the
+     * analyzer can be shared by threads that only call accepts. */
+    void prepare() {
+      if (!isRegular && !isLL && !isOP && !isMixed && earleyVer != ver) {
+        earley.compile(prods, varIds, vars.size());
+        earleyVer = ver;
+      }
+    }
+
+    /* Same result as validStr, but it never logs or compiles anything, so
+     * many threads can call it at once while nothing updates the analyzer.
+     * prepare must have been called after the last update. */
+    bool accepts(const std::string &str) const {
+      if (!Utf8::valid(str.data(), str.size())) return false;
+      if (profile) {
+        checkPrepared();
+        return profileStr(str);
+      }
+      if (results) {
+        checkPrepared();
+        return cachedResult(str).valid;
+      }
+      if (isRegular) return testAutomaton(str);
+      if (isLL) return testIds(str);
+      if (isOP) {
+        std::vector<int> ids;
+        for (const std::string &word : splitWords(str))
+          ids.push_back(terminalId(word));
+        return precedence.recognize(ids);
+      }
+      if (isMixed) return recognizeMixed(wordIds(str));
+      checkPrepared();
+      return earley.recognize(splitWords(str));
+    }
+
+    /* Same result as accepts plus, for a rejected string of a regular or LL
+     * grammar, the word where it stopped (the number of words if it ended too
+     * soon) and the terminals that could have been there. */
+    StrDiagnosis diagnose(const std::string &str) const {
+      StrDiagnosis diagnosis{false, RESULT_NO_POSITION, {}};
+      CachedResult result;
+
+      if (!Utf8::valid(str.data(), str.size())) return diagnosis;
+      checkPrepared();
+      result = cachedResult(str);
+      diagnosis.valid = result.valid;
+      diagnosis.position = result.position;
+      for (const int t : result.expected)
+        diagnosis.expected.push_back(termNames[t]);
+      return diagnosis;
+    }
+
+    /* Keeps the results of up to capacity strings (split in shards with
+     * their own lock) for validStr, accepts and diagnose, so a repeated
+     * string is not recognized again. The results are dropped on every
+     * update. 0 removes the cache. */
+    void setResultCache(size_t capacity, size_t shards = RESULT_CACHE_SHARDS) {
+      if (capacity == 0) results.reset();
+      else results.reset(new ResultCache(capacity, shards));
+    }
+
+    /* Cache of results or NULL if there is none */
+    const ResultCache * getResultCache() const { return results.get(); }
+
+    /* Turns on or off the counting of what validStr and accepts do on
+     * every string (see RecognitionProfile). The result cache is not used
+     * while profiling, so every string is counted. Every update starts a
+     * new profile for the new grammar. */
+    void setProfiling(bool on) {
+      if (!on) profile.reset();
+      else if (!profile) newProfile();
+    }
+
+    /* Profile that is counting, NULL if profiling is off. It can be read
+     * while other threads are counting. */
+    std::shared_ptr<const RecognitionProfile> getProfile() const {
+      return profile;
+    }
+
+    /* Runs the analysis of the grammar within the limits of the control.
+     * parse(..., false) followed by analyze is like parse with an update that
+     * can be stopped. A stopped run returns CANCELLED or TIMED_OUT and keeps
+     * the phases it finished: the FIRST of every variable once the FIRST
+     * phase is done, FOLLOW after its phase and is_ll after LL_CHECK. The
+     * next call goes on from the phase that was stopped. */
+    AnalysisStatus analyze(const AnalysisControl &control_) {
+      return runAnalysis(control_);
+    }
+
+    /* First phase of the analysis that is not done */
+    AnalysisPhase getPhase() const { return phase; }
+
+    /* Runs the whole analysis like update, but copies FIRST and FOLLOW
+     * from the analysis of an earlier version of the grammar (with the same
+     * start symbol) for the variables the edit can not have changed. Parse
+     * the rules with runUpdate set to false before. previous must not change
+     * during the call. */
+    void reanalyze(const LexicalAnalyzer &previous_) {
+      previous = &previous_;
+      try {
+        update();
+      } catch (...) {
+        previous = NULL;
+        sameFirst.clear(); sameFollow.clear();
+        throw;
+      }
+      previous = NULL;
+      sameFirst.clear(); sameFollow.clear();
+    }
+
+    /* Variables whose FIRST and FOLLOW the last analysis copied */
+    size_t getReused() const { return reused; }
 
     bool is_ll() { return isLL; }
 
+    bool is_operator_precedence() { return isOP; }
+
+    /* Returns if the grammar is LL once its expressions (see
+     * getExpressionVariables) are read with operator precedence */
+    bool is_ll_with_expressions() { return isMixed; }
+
+    /* Variables read with operator precedence inside a grammar that is not
+     * LL, in the order they were found from the start symbol */
+    std::list<std::string> getExpressionVariables() const {
+      std::vector<std::string> names(expressions.size());
+      for (size_t v = 0; v < expressionOf.size(); v++)
+        if (expressionOf[v] >= 0) names[expressionOf[v]] = vars[v].name;
+      return std::list<std::string>(names.begin(), names.end());
+    }
+
+    /* Returns if the grammar is right or left linear */
+    bool is_regular() { return isRegular; }
+
+    /* Declares the precedence and associativity of a terminal, a higher
+     * level binds tighter. When the relations of two terminals with a
+     * precedence conflict, like the operators of E -> E + E | E * E, they are
+     * chosen by it. They are used for the whole grammar and for the
+     * expressions inside a grammar of statements. Declare them before parsing
+     * the grammar, they are used on the next update. */
+    void setPrecedence(const std::string &terminal, int level,
+      Associativity assoc = Associativity::LEFT) {
+      precedence.declare(terminal, level, assoc);
+    }
+
+    /* Sets the most bytes the grammar and its analysis can use, 0 removes the
+     * limit. A parse or update that needs more throws a runtime_error and
+     * keeps the productions parsed before it; a failed update leaves no
+     * analysis until the next one. */
+    void setMemoryBudget(size_t bytes) { memory->setBudget(bytes); }
+
+    /* Bytes in use by symbol tables, productions, sets and tables */
+    const MemoryAccount & getMemory() const { return *memory; }
+
+    std::string memoryReport() const { return memory->report(); }
+
+    /* Parses the string with the LL table and runs the semantic actions of
+     * the productions during the same pass. Actions is any type with:
+     *   Value shift(const std::string &terminal)
+     *     Value of a matched terminal.
+     *   Value reduce(size_t prod, Value *values, size_t n)
+     *     Value of production prod (see getProdId), it receives the values of
+     *     its n elements in order. EPSILON has no value.
+     * Actions is a template parameter so the calls are resolved (and usually
+     * inlined) at compile time. Returns false if the grammar is not LL or the
+     * string is not valid, else result gets the value of the start symbol. */
+    template <typename Value, typename Actions>
+    bool translate(const std::string &str, Actions &actions, Value &result) {
+      struct Entry {
+        int code; // Symbol like in codes, or the production to reduce
+        bool reduce;
+      };
+      const size_t nterms = termNames.size();
+      const int end = nterms - 1; // "$"
+      std::vector<std::string> words = splitWords(str);
+      SmallStack<Entry> stack;
+      SmallStack<Value> values;
+      size_t pos = 0;
+      int term;
+
+      if (!isLL || prods.empty()) return false;
+
+      stack.push(Entry{-1 - (int)varIds[prods.variable(0)], false});
+      term = (words.empty())? end : terminalId(words[0]);
+
+      while (!stack.empty()) {
+        Entry top = stack.top();
+        stack.pop();
+
+        if (top.reduce) {
+          size_t n = prods.offset(top.code + 1) - prods.offset(top.code);
+          for (size_t i = prods.offset(top.code); i < prods.offset(top.code+1); i++)
+            if (codes[i] == EPSILON_CODE) n--;
+          Value value = actions.reduce((size_t)top.code, values.last(n), n);
+          values.pop(n);
+          values.push(std::move(value));
+        } else if (top.code >= 0) {
+          // Terminal, must be the lookahead
+          if (top.code != term) return false;
+          values.push(actions.shift(words[pos]));
+          pos++;
+          term = (pos < words.size())? terminalId(words[pos]) : end;
+        } else {
+          // Variable, expand the production of the lookahead
+          size_t v = -1 - top.code;
+          int p = (term >= 0)? llTable.get(v, term) : -1;
+          if (p == -1) p = nullProd[v];
+          if (p == -1) return false;
+          stack.push(Entry{p, true});
+          for (size_t i = prods.offset(p+1); i-- > prods.offset(p);)
+            if (codes[i] != EPSILON_CODE) stack.push(Entry{codes[i], false});
+        }
+      }
+
+      if (term != end || values.size() != 1) return false;
+      result = std::move(values.top());
+      return true;
+    }
+
     std::string toString() {
       std::string str = "";
-      for (Production prod : prods) {
-        str.append(prod.toString());
+      for (size_t p = 0; p < prods.size(); p++) {
+        str.append(prods[p].toString());
         str.append("\n");
       }
       str.pop_back();
@@ -580,11 +1867,24 @@ class LexicalAnalyzer {
       return calcFollow(str);
     }
 
+    /* Returns the id of a production given as "variable -> elements" or -1
+     * if it is not part of the grammar. The ids are the ones received by the
+     * semantic actions of translate. */
+    long getProdId(const std::string &production) {
+      for (size_t p = 0; p < prods.size(); p++)
+        if (prods[p].toString() == production) return p;
+      return -1;
+    }
+
+    /* Returns the production of the LL table for the variable and the
+     * terminal (or EPSILON), "" if there is none or the grammar is not LL */
     std::string getProd(const std::string &v, const std::string &t) {
       Variable *var = getVar(v);
-      if (var && var->hasTerm(t))
-        return var->table[t]->toString();
-      return "";
+      int p;
+      if (!isLL || !var || !var->hasTerm(t)) return "";
+      p = (t.compare(EPSILON) == 0)? nullProd[varIds[v]] :
+        llTable.get(varIds[v], terminalId(t));
+      return (p >= 0)? prods[p].toString() : "";
     }
 
 };
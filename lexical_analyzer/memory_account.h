@@ -0,0 +1,145 @@
+#ifndef memory_account
+#define memory_account
+
+#include <atomic>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#define MEMORY_CATEGORIES 4
+
+/* Part of the analyzer that owns an allocation */
+enum class MemoryCategory { SYMBOLS, PRODUCTIONS, SETS, TABLES };
+
+/* Thrown by a CountingAllocator when an allocation does not fit in the
+ * budget of its account */
+class MemoryBudgetError : public std::bad_alloc {
+  public:
+    const char * what() const noexcept { return "Memory budget exceeded"; }
+};
+
+/* Bytes in use by category, with an optional budget for the total. The
+ * counters are atomic so the containers can be filled from any thread. */
+class MemoryAccount {
+  private:
+    std::atomic<size_t> used[MEMORY_CATEGORIES];
+    std::atomic<size_t> total, peak;
+    size_t budget; // 0 means no limit
+
+  public:
+    MemoryAccount() : total(0), peak(0), budget(0) {
+      for (size_t c = 0; c < MEMORY_CATEGORIES; c++) used[c] = 0;
+    }
+
+    /* Counts bytes for a category. Throws MemoryBudgetError and counts
+     * nothing if the total would go over the budget. */
+    void charge(MemoryCategory category, size_t bytes) {
+      size_t now = total.fetch_add(bytes) + bytes, old = peak;
+      if (budget != 0 && now > budget) {
+        total.fetch_sub(bytes);
+        throw MemoryBudgetError();
+      }
+      used[(size_t)category].fetch_add(bytes);
+      while (now > old && !peak.compare_exchange_weak(old, now));
+    }
+
+    void release(MemoryCategory category, size_t bytes) {
+      used[(size_t)category].fetch_sub(bytes);
+      total.fetch_sub(bytes);
+    }
+
+    /* Sets the most bytes that can be in use, 0 removes the limit. Memory
+     * already in use is not freed. */
+    void setBudget(size_t bytes) { budget = bytes; }
+
+    size_t getBudget() const { return budget; }
+
+    size_t getUsed(MemoryCategory category) const {
+      return used[(size_t)category];
+    }
+
+    size_t getTotal() const { return total; }
+
+    size_t getPeak() const { return peak; }
+
+    /* Bytes by category, one per line */
+    std::string report() const {
+      const char *names[MEMORY_CATEGORIES] =
+        {"symbols", "productions", "sets", "tables"};
+      char line[96];
+      std::string str;
+
+      for (size_t c = 0; c < MEMORY_CATEGORIES; c++) {
+        snprintf(line, sizeof(line), "%-12s %zu\n", names[c], (size_t)used[c]);
+        str.append(line);
+      }
+      snprintf(line, sizeof(line), "%-12s %zu\n%-12s %zu\n", "total",
+        (size_t)total, "peak", (size_t)peak);
+      str.append(line);
+      if (budget != 0) {
+        snprintf(line, sizeof(line), "%-12s %zu\n", "budget", budget);
+        str.append(line);
+      }
+      return str;
+    }
+};
+
+/* Allocator that charges every allocation of a container to a category of
+ * an account. A default constructed allocator counts nothing. Containers
+ * keep their allocator when they are assigned, so an analyzer is charged for
+ * whatever is copied or moved into its containers. */
+template <typename T>
+class CountingAllocator {
+  private:
+    MemoryAccount *account;
+    MemoryCategory category;
+
+    template <typename U> friend class CountingAllocator;
+
+  public:
+    typedef T value_type;
+
+    CountingAllocator() : account(NULL), category(MemoryCategory::SYMBOLS) {}
+
+    CountingAllocator(MemoryAccount *account_, MemoryCategory category_) :
+      account(account_), category(category_) {}
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U> &other) :
+      account(other.account), category(other.category) {}
+
+    T * allocate(size_t n) {
+      if (account != NULL) account->charge(category, n * sizeof(T));
+      try {
+        return std::allocator<T>().allocate(n);
+      } catch (...) {
+        if (account != NULL) account->release(category, n * sizeof(T));
+        throw;
+      }
+    }
+
+    void deallocate(T *ptr, size_t n) {
+      std::allocator<T>().deallocate(ptr, n);
+      if (account != NULL) account->release(category, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator == (const CountingAllocator<U> &other) const {
+      return account == other.account && category == other.category;
+    }
+
+    template <typename U>
+    bool operator != (const CountingAllocator<U> &other) const {
+      return !(*this == other);
+    }
+};
+
+template <typename T>
+using CountedVector = std::vector<T, CountingAllocator<T>>;
+
+typedef std::list<std::string, CountingAllocator<std::string>> CountedList;
+
+#endif
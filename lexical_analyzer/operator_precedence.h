@@ -0,0 +1,351 @@
+#ifndef operator_precedence
+#define operator_precedence
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "production_set.h"
+#include "small_stack.h"
+#include "symbol_sets.h"
+
+#define OP_EPSILON "''"
+#define OP_MAX_VARS 64
+
+enum class Associativity { LEFT, RIGHT, NONE };
+
+/* Operator precedence recognizer (Floyd). It works for operator grammars (no
+ * EPSILON and no two variables next to each other) where the relations
+ * between terminals derived from LEADING and TRAILING do not conflict. A
+ * conflict between two terminals with a declared precedence is solved with
+ * their levels and associativity, so ambiguous expression grammars work too.
+ * Every word costs a lookup in the relation table and every reduction a
+ * lookup of its handle, without the chains of EPrime and TPrime variables an
+ * LL grammar needs. It can be built for the whole grammar or only for the
+ * variables reached from one of them, the expressions inside a grammar of
+ * statements. Variables are kept as masks of the variables they can be, so
+ * at most OP_MAX_VARS variables are reached. */
+class OperatorPrecedence {
+  private:
+    struct Level {
+      int level; // Higher binds tighter, -1 if not declared
+      Associativity assoc;
+    };
+
+    struct Entry {
+      int term;      // Terminal id or -1 for a variable
+      uint64_t vars; // Variables it can be, when it is a variable
+    };
+
+    std::map<std::string, Level> declared;
+    size_t nterms;
+    int start; // Local id of the root, -1 if nothing was built
+    std::vector<char> relation; // '<', '=', '>' or 0 by pair of terminals
+    std::vector<bool> resolved; // Relations chosen by precedence
+    TermSet startTrailing; // Terminals that can be the last one on the stack
+
+    // Right hand sides of the productions that are not a single variable
+    std::vector<size_t> ruleOffsets; // Rule r is ruleSyms[ruleOffsets[r]..]
+    std::vector<int> ruleSyms;       // Terminal id or -1 - variable id
+    std::vector<uint64_t> ruleHeads; // Variables that derive the rule
+    std::unordered_map<uint64_t, std::vector<size_t>> handles; // By skeleton
+    size_t maxLen;
+
+    /* Hash of the terminals of a handle, variables count as -1 */
+    static uint64_t skeleton(const int *syms, size_t n) {
+      uint64_t hash = 1469598103934665603ULL;
+      for (size_t i = 0; i < n; i++) {
+        hash ^= (uint64_t)(uint32_t)((syms[i] < 0)? -1 : syms[i]);
+        hash *= 1099511628211ULL;
+      }
+      return hash;
+    }
+
+    /* Sets the relation between two terminals. Returns false on a conflict
+     * that the declared precedence does not solve. */
+    bool relate(size_t a, size_t b, char rel,
+      const std::vector<Level> &levels) {
+      const size_t cell = a * nterms + b;
+
+      if (resolved[cell] && rel != '=') return true;
+      if (relation[cell] == 0 || relation[cell] == rel) {
+        relation[cell] = rel;
+        return true;
+      }
+      if (rel == '=' || relation[cell] == '=') return false;
+
+      // '<' against '>', both terminals must have a precedence
+      if (levels[a].level < 0 || levels[b].level < 0) return false;
+      if (levels[a].level > levels[b].level) relation[cell] = '>';
+      else if (levels[a].level < levels[b].level) relation[cell] = '<';
+      else if (levels[a].assoc == Associativity::LEFT) relation[cell] = '>';
+      else if (levels[a].assoc == Associativity::RIGHT) relation[cell] = '<';
+      else relation[cell] = 0;
+      resolved[cell] = true;
+      return true;
+    }
+
+    /* Reduces the handle at the top of the stack. top is the index of the
+     * topmost terminal and gets the new one. */
+    bool reduce(SmallStack<Entry> &stack, size_t &top) const {
+      size_t first = top, from, n;
+      int syms[64];
+
+      // Leftmost terminal of the handle
+      while (true) {
+        size_t prev = (stack[first - 1].term < 0)? first - 2 : first - 1;
+        if (relation[stack[prev].term * nterms + stack[first].term] != '=')
+          break;
+        first = prev;
+      }
+      from = (stack[first - 1].term < 0)? first - 1 : first;
+      n = stack.size() - from;
+      if (n > maxLen) return false;
+
+      for (size_t i = 0; i < n; i++) syms[i] = stack[from + i].term;
+      std::unordered_map<uint64_t, std::vector<size_t>>::const_iterator it =
+        handles.find(skeleton(syms, n));
+      if (it == handles.end()) return false;
+
+      uint64_t vars = 0;
+      for (const size_t r : it->second) {
+        if (ruleOffsets[r+1] - ruleOffsets[r] != n) continue;
+        bool match = true;
+        for (size_t i = 0; i < n && match; i++) {
+          int sym = ruleSyms[ruleOffsets[r] + i];
+          const Entry &entry = stack[from + i];
+          if (sym >= 0) match = entry.term == sym;
+          else match = entry.term < 0 && ((entry.vars >> (-1 - sym)) & 1);
+        }
+        if (match) vars |= ruleHeads[r];
+      }
+      if (vars == 0) return false;
+
+      stack.pop(n);
+      stack.push(Entry{-1, vars});
+      top = from - 1;
+      return true;
+    }
+
+  public:
+    OperatorPrecedence() { nterms = 0; start = -1; maxLen = 0; }
+
+    /* Declares the precedence of a terminal. It is used on the next compile
+     * to solve conflicts between terminals that both have one. */
+    void declare(const std::string &terminal, int level, Associativity assoc) {
+      declared[terminal] = Level{level, assoc};
+    }
+
+    void clear() { declared.clear(); }
+
+    /* Builds the relations for the productions. The ids of the variables must
+     * be the ones used to index the ProductionSet and termIds must give the
+     * ids 0..nterms-1 with "$" as the last one. Returns false if the grammar
+     * is not an operator precedence grammar. */
+    bool compile(const ProductionSet &prods,
+      const std::map<std::string, size_t> &varIds, size_t nvars,
+      const std::map<std::string, size_t> &termIds, size_t nterms_) {
+      if (prods.empty()) { start = -1; return false; }
+      return compile(prods, varIds, nvars, termIds, nterms_,
+        varIds.at(prods.variable(0)));
+    }
+
+    /* Same as compile, but only for root and the variables it reaches, with
+     * root as the start symbol. The ProductionSet must be indexed. */
+    bool compile(const ProductionSet &prods,
+      const std::map<std::string, size_t> &varIds, size_t nvars,
+      const std::map<std::string, size_t> &termIds, size_t nterms_,
+      size_t root) {
+      std::map<std::string, size_t>::const_iterator it;
+      std::vector<Level> levels(nterms_, Level{-1, Associativity::LEFT});
+      std::vector<int> syms, local(nvars, -1);
+      std::vector<size_t> offsets(1, 0), region(1, root), rules, heads;
+      const int end = nterms_ - 1;
+
+      nterms = nterms_;
+      start = -1;
+
+      // Variables reached from the root, numbered from 0
+      local[root] = 0;
+      for (size_t k = 0; k < region.size(); k++)
+        for (const size_t p : prods.productionsOf(region[k])) {
+          rules.push_back(p);
+          for (const std::string &elem : prods.elements(p))
+            if ((it = varIds.find(elem)) != varIds.end() &&
+                local[it->second] < 0) {
+              if (region.size() == OP_MAX_VARS) return false;
+              local[it->second] = region.size();
+              region.push_back(it->second);
+            }
+        }
+
+      for (const std::pair<const std::string, Level> &decl : declared)
+        if ((it = termIds.find(decl.first)) != termIds.end())
+          levels[it->second] = decl.second;
+
+      // Encode the productions, it must be an operator grammar
+      for (const size_t p : rules) {
+        for (const std::string &elem : prods.elements(p)) {
+          if (elem.compare(OP_EPSILON) == 0) return false;
+          if ((it = varIds.find(elem)) != varIds.end()) {
+            if (syms.size() > offsets.back() && syms.back() < 0) return false;
+            syms.push_back(-1 - local[it->second]);
+          } else {
+            syms.push_back(termIds.at(elem));
+          }
+        }
+        offsets.push_back(syms.size());
+        heads.push_back(local[varIds.at(prods.variable(p))]);
+      }
+
+      // LEADING and TRAILING of every variable
+      std::vector<TermSet> leading(region.size(), TermSet(nterms));
+      std::vector<TermSet> trailing(region.size(), TermSet(nterms));
+      for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t p = 0; p < rules.size(); p++) {
+          size_t head = heads[p];
+          const int *b = syms.data() + offsets[p];
+          size_t n = offsets[p+1] - offsets[p];
+          TermSet &lead = leading[head], &trail = trailing[head];
+
+          // A terminal first or right after a first variable
+          int t = (b[0] >= 0 || n == 1)? b[0] : b[1];
+          if (b[0] < 0) changed |= lead.merge(leading[-1 - b[0]]);
+          if (t >= 0 && !lead.has(t)) { lead.insert(t); changed = true; }
+
+          // A terminal last or right before a last variable
+          t = (b[n-1] >= 0 || n == 1)? b[n-1] : b[n-2];
+          if (b[n-1] < 0) changed |= trail.merge(trailing[-1 - b[n-1]]);
+          if (t >= 0 && !trail.has(t)) { trail.insert(t); changed = true; }
+        }
+      }
+
+      // Relations between terminals
+      bool ok = true;
+      relation.assign(nterms * nterms, 0);
+      resolved.assign(nterms * nterms, false);
+      for (size_t p = 0; p < rules.size() && ok; p++) {
+        const int *b = syms.data() + offsets[p];
+        size_t n = offsets[p+1] - offsets[p];
+        for (size_t i = 0; i + 1 < n && ok; i++) {
+          if (b[i] >= 0 && b[i+1] >= 0)
+            ok = relate(b[i], b[i+1], '=', levels);
+          if (b[i] >= 0 && b[i+1] < 0) {
+            if (i + 2 < n) ok = ok && relate(b[i], b[i+2], '=', levels);
+            leading[-1 - b[i+1]].forEach([&](size_t t) {
+              ok = ok && relate(b[i], t, '<', levels);
+            });
+          }
+          if (b[i] < 0)
+            trailing[-1 - b[i]].forEach([&](size_t t) {
+              ok = ok && relate(t, b[i+1], '>', levels);
+            });
+        }
+      }
+      start = 0;
+      leading[start].forEach([&](size_t t) {
+        ok = ok && relate(end, t, '<', levels);
+      });
+      trailing[start].forEach([&](size_t t) {
+        ok = ok && relate(t, end, '>', levels);
+      });
+      if (!ok) { start = -1; return false; }
+      startTrailing = trailing[start];
+
+      // Variables that derive each variable through single variable rules
+      std::vector<uint64_t> above(region.size());
+      for (size_t v = 0; v < region.size(); v++) above[v] = (uint64_t)1 << v;
+      for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t p = 0; p < rules.size(); p++) {
+          if (offsets[p+1] - offsets[p] != 1 || syms[offsets[p]] >= 0) continue;
+          uint64_t &mask = above[-1 - syms[offsets[p]]];
+          uint64_t more = above[heads[p]] & ~mask;
+          if (more) { mask |= more; changed = true; }
+        }
+      }
+
+      // Handles
+      ruleOffsets.assign(1, 0);
+      ruleSyms.clear();
+      ruleHeads.clear();
+      handles.clear();
+      maxLen = 0;
+      for (size_t p = 0; p < rules.size(); p++) {
+        size_t n = offsets[p+1] - offsets[p];
+        if (n == 1 && syms[offsets[p]] < 0) continue;
+        if (n > 64) { start = -1; return false; }
+        handles[skeleton(syms.data() + offsets[p], n)].push_back(
+          ruleHeads.size());
+        ruleSyms.insert(ruleSyms.end(), syms.begin() + offsets[p],
+          syms.begin() + offsets[p+1]);
+        ruleOffsets.push_back(ruleSyms.size());
+        ruleHeads.push_back(above[heads[p]]);
+        if (n > maxLen) maxLen = n;
+      }
+      return true;
+    }
+
+    /* Returns if the terminals (ids given to compile, -1 for a word that is
+     * not a terminal) can be derived from the start symbol */
+    bool recognize(const std::vector<int> &terms) const {
+      size_t i = 0;
+      return recognizePrefix(terms, i) && i == terms.size();
+    }
+
+    /* Reads an expression of the start symbol from terms[i]. It ends at the
+     * first word it can not go on with, like the end of the terms, and i
+     * gets the position of that word. Returns false if the words read are
+     * not an expression. */
+    bool recognizePrefix(const std::vector<int> &terms, size_t &i) const {
+      const int end = nterms - 1;
+      SmallStack<Entry> stack;
+      size_t top = 0;
+      bool ended = false;
+
+      if (start < 0) return false;
+      stack.push(Entry{end, 0});
+      while (true) {
+        int a = stack[top].term, b = (ended || i == terms.size())? end :
+          terms[i];
+        // From the first word with no relation on, it reduces like at the end
+        if (b < 0 || b == end || relation[a * nterms + b] == 0) {
+          b = end;
+          ended = true;
+        }
+        if (a == end && b == end)
+          return stack.size() == 2 && stack[1].term < 0 &&
+            ((stack[1].vars >> start) & 1);
+
+        char rel = relation[a * nterms + b];
+        if (rel == '<' || rel == '=') {
+          stack.push(Entry{b, 0});
+          top = stack.size() - 1;
+          i++;
+        } else if (rel != '>' || !reduce(stack, top)) {
+          return false;
+        }
+      }
+    }
+
+    /* Returns if the terminal, when it comes right after an expression, is
+     * never read as part of it. Then recognizePrefix ends the expression
+     * right before it, which is where a grammar that uses the start symbol
+     * followed by the terminal needs it to end. */
+    bool endsBefore(size_t t) const {
+      const size_t end = nterms - 1;
+      if (start < 0) return false;
+      bool ends = relation[end * nterms + t] != '<' &&
+        relation[end * nterms + t] != '=';
+      startTrailing.forEach([&](size_t a) {
+        ends = ends && relation[a * nterms + t] != '<' &&
+          relation[a * nterms + t] != '=';
+      });
+      return ends;
+    }
+};
+
+#endif
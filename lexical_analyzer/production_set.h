@@ -0,0 +1,195 @@
+#ifndef production_set
+#define production_set
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "memory_account.h"
+
+/* Read only view over a contiguous piece of an array. It does not own the
+ * memory so it is only valid while the array it points to is not modified. */
+template <typename T>
+class Span {
+  private:
+    const T *first_, *last_;
+
+  public:
+    Span() : first_(nullptr), last_(nullptr) {}
+
+    Span(const T *first, const T *last) : first_(first), last_(last) {}
+
+    const T * begin() const { return first_; }
+
+    const T * end() const { return last_; }
+
+    size_t size() const { return last_ - first_; }
+
+    bool empty() const { return first_ == last_; }
+
+    const T & front() const { return *first_; }
+
+    const T & back() const { return *(last_ - 1); }
+
+    const T & operator [] (size_t i) const { return first_[i]; }
+};
+
+/* A production as seen from the ProductionSet that stores it. */
+class Production {
+  private:
+    const std::string *variable;
+    Span<std::string> elements;
+
+  public:
+    Production(const std::string *variable_, Span<std::string> elements_) :
+      variable(variable_), elements(elements_) {}
+
+    std::string toString() const {
+      std::string str = *variable;
+      str.append(" -> ");
+      for (const std::string &elem : elements) {
+        str.append(elem);
+        str.append(" ");
+      }
+      str.pop_back();
+      return str;
+    }
+
+    std::string getVariable() const { return *variable; }
+
+    std::list<std::string> getElements() const {
+      return std::list<std::string>(elements.begin(), elements.end());
+    }
+
+    const Span<std::string> & getSpan() const { return elements; }
+};
+
+/* Position of a variable inside the right hand side of a production. */
+struct Occurrence {
+  size_t prod; // Production that has the variable on its right hand side
+  size_t pos;  // Index of the variable in the flat element array
+};
+
+/* Stores every production of a grammar in compressed sparse rows: all right
+ * hand sides are packed one after the other in a single array and every
+ * production only keeps the offset where it starts. After calling index()
+ * the productions of a variable and the places where a variable is used are
+ * also available as contiguous spans, so no analysis needs to copy or scan
+ * the whole grammar. */
+class ProductionSet {
+  private:
+    CountedVector<std::string> heads; // Variable of each production
+    CountedVector<std::string> body;  // Every right hand side, one after other
+    CountedVector<size_t> offsets;    // Production p is body[offsets[p]..[p+1])
+
+    CountedVector<size_t> varOffsets; // Variable v owns byVar[varOffsets[v]..]
+    CountedVector<size_t> byVar;      // Production ids grouped by variable
+    CountedVector<size_t> occOffsets; // Variable v owns occs[occOffsets[v]..]
+    CountedVector<Occurrence> occs;   // Occurrences grouped by variable
+
+  public:
+    /* The arrays are charged to the account, if there is one */
+    ProductionSet(MemoryAccount *account = NULL) :
+      heads(CountingAllocator<char>(account, MemoryCategory::PRODUCTIONS)),
+      body(heads.get_allocator()), offsets(heads.get_allocator()),
+      varOffsets(heads.get_allocator()), byVar(heads.get_allocator()),
+      occOffsets(heads.get_allocator()), occs(heads.get_allocator()) {
+      offsets.push_back(0);
+    }
+
+    void clear() {
+      heads.clear();
+      body.clear();
+      offsets.assign(1, 0);
+      varOffsets.clear();
+      byVar.clear();
+      occOffsets.clear();
+      occs.clear();
+    }
+
+    /* Appends a production. The indexes are outdated until index() runs. */
+    void add(const std::string &variable,
+      const std::vector<std::string> &elements) {
+      size_t size = body.size();
+      try {
+        heads.push_back(variable);
+        body.insert(body.end(), elements.begin(), elements.end());
+        offsets.push_back(body.size());
+      } catch (const std::bad_alloc &) {
+        // Leave the set as it was
+        heads.resize(offsets.size() - 1);
+        body.resize(size);
+        throw;
+      }
+    }
+
+    /* Rebuilds the per variable indexes. The id of each variable is given by
+     * the map and must be lower than nvars. Productions keep the order in
+     * which they were added inside each variable. */
+    void index(const std::map<std::string, size_t> &ids, size_t nvars) {
+      std::map<std::string, size_t>::const_iterator it;
+      std::vector<size_t> headIds(heads.size());
+
+      varOffsets.assign(nvars + 1, 0);
+      occOffsets.assign(nvars + 1, 0);
+
+      // Count productions and occurrences per variable
+      for (size_t p = 0; p < heads.size(); p++) {
+        headIds[p] = ids.at(heads[p]);
+        varOffsets[headIds[p] + 1]++;
+        for (size_t i = offsets[p]; i < offsets[p+1]; i++)
+          if ((it = ids.find(body[i])) != ids.end()) occOffsets[it->second+1]++;
+      }
+      for (size_t v = 0; v < nvars; v++) {
+        varOffsets[v+1] += varOffsets[v];
+        occOffsets[v+1] += occOffsets[v];
+      }
+
+      // Fill the rows
+      std::vector<size_t> nextVar(varOffsets.begin(), varOffsets.end() - 1);
+      std::vector<size_t> nextOcc(occOffsets.begin(), occOffsets.end() - 1);
+      byVar.resize(heads.size());
+      occs.resize(occOffsets[nvars]);
+      for (size_t p = 0; p < heads.size(); p++) {
+        byVar[nextVar[headIds[p]]++] = p;
+        for (size_t i = offsets[p]; i < offsets[p+1]; i++)
+          if ((it = ids.find(body[i])) != ids.end())
+            occs[nextOcc[it->second]++] = Occurrence{p, i};
+      }
+    }
+
+    size_t size() const { return heads.size(); }
+
+    bool empty() const { return heads.empty(); }
+
+    Production operator [] (size_t p) const {
+      return Production(&heads[p], elements(p));
+    }
+
+    const std::string & variable(size_t p) const { return heads[p]; }
+
+    Span<std::string> elements(size_t p) const {
+      return Span<std::string>(body.data()+offsets[p], body.data()+offsets[p+1]);
+    }
+
+    const std::string & element(size_t pos) const { return body[pos]; }
+
+    /* Position of the first element of production p in the flat array. The
+     * offset of size() is the amount of elements. */
+    size_t offset(size_t p) const { return offsets[p]; }
+
+    /* Productions of the variable with the received id */
+    Span<size_t> productionsOf(size_t var) const {
+      return Span<size_t>(byVar.data() + varOffsets[var],
+        byVar.data() + varOffsets[var+1]);
+    }
+
+    /* Places where the variable with the received id is on a right hand side */
+    Span<Occurrence> occurrencesOf(size_t var) const {
+      return Span<Occurrence>(occs.data() + occOffsets[var],
+        occs.data() + occOffsets[var+1]);
+    }
+};
+
+#endif
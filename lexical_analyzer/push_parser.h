@@ -0,0 +1,74 @@
+#ifndef push_parser
+#define push_parser
+
+#include <string>
+#include <vector>
+
+#include "lexical_analyzer.h"
+#include "production_set.h"
+
+enum class ParseState { NEED_MORE, ACCEPT, REJECT };
+
+/* Validates a string that arrives one word at a time with the LL table of an
+ * analyzer. Nothing but the predictive stack is kept, so strings of any
+ * length can be checked while they are produced. The analyzer must be LL and
+ * must not be updated while the parser is used. */
+class PushParser {
+  private:
+    const LexicalAnalyzer &analyzer;
+    std::vector<int> stack;
+    ParseState state;
+    size_t count; // Words read
+
+  public:
+    PushParser(const LexicalAnalyzer &analyzer_) : analyzer(analyzer_) {
+      reset();
+    }
+
+    /* Starts a new string */
+    void reset() {
+      stack = analyzer.startStack();
+      state = (analyzer.isLL)? ParseState::NEED_MORE : ParseState::REJECT;
+      count = 0;
+    }
+
+    /* Reads the next word. Once the string is rejected the words are
+     * ignored. */
+    ParseState feed(const std::string &word) {
+      if (state != ParseState::NEED_MORE) return state;
+      int term = analyzer.terminalId(word);
+      if (term < 0 || !analyzer.step(stack, term)) state = ParseState::REJECT;
+      else count++;
+      return state;
+    }
+
+    /* Reads several words in order */
+    ParseState feed(Span<std::string> words) {
+      for (const std::string &word : words)
+        if (feed(word) != ParseState::NEED_MORE) break;
+      return state;
+    }
+
+    ParseState feed(const std::vector<std::string> &words) {
+      return feed(Span<std::string>(words.data(), words.data() + words.size()));
+    }
+
+    /* Marks the end of the string. The state is ACCEPT or REJECT. */
+    ParseState finish() {
+      if (state != ParseState::NEED_MORE) return state;
+      const int end = analyzer.termNames.size() - 1;
+      state = (analyzer.step(stack, end))?
+        ParseState::ACCEPT : ParseState::REJECT;
+      return state;
+    }
+
+    ParseState getState() const { return state; }
+
+    /* Words read before the string was rejected or finished */
+    size_t getCount() const { return count; }
+
+    /* Symbols on the predictive stack */
+    size_t depth() const { return stack.size(); }
+};
+
+#endif
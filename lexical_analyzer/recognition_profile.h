@@ -0,0 +1,217 @@
+#ifndef recognition_profile
+#define recognition_profile
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#define PROFILE_THREAD_CACHE 8 // Profiles a thread finds without the lock
+
+/* What a profile counted, added over every thread. The productions and the
+ * cells that were expanded go from the most expanded one down. */
+struct ProfileSummary {
+  uint64_t sentences, accepted;
+  uint64_t tokens, maxTokens; // Words of every string and of the longest
+  uint64_t maxDepth;          // Highest predictive stack
+  std::vector<std::pair<std::string, uint64_t>> productions;
+  std::vector<std::pair<std::string, uint64_t>> cells; // "variable, term"
+};
+
+/* Counts what the predictive parser does on real strings: the expansions
+ * of every production and of every cell of the LL table, the words of the
+ * strings and the height of the stack. Every thread counts in counters of
+ * its own, found through a small thread local cache, so counting takes no
+ * lock and no atomic read-modify-write. A thread that misses the cache finds
+ * its counters by thread id under the lock, so it never gets two. The
+ * counters are only added up when a summary is asked for. */
+class RecognitionProfile {
+  public:
+    typedef std::unique_ptr<std::atomic<uint64_t>[]> Array;
+
+    /* Counters of one thread. Only their thread writes them, the atomics
+     * are there so a summary can read them at the same time. */
+    class Counters {
+      private:
+        Array prods, cells;
+        std::atomic<uint64_t> sentences, accepted, tokens, maxTokens,
+          maxDepth;
+
+        static void add(std::atomic<uint64_t> &counter, uint64_t n) {
+          counter.store(counter.load(std::memory_order_relaxed) + n,
+            std::memory_order_relaxed);
+        }
+
+        static void raise(std::atomic<uint64_t> &counter, uint64_t n) {
+          if (n > counter.load(std::memory_order_relaxed))
+            counter.store(n, std::memory_order_relaxed);
+        }
+
+        friend class RecognitionProfile;
+
+      public:
+        Counters(size_t nprods, size_t ncells) :
+          prods(new std::atomic<uint64_t>[nprods]()),
+          cells(new std::atomic<uint64_t>[ncells]()),
+          sentences(0), accepted(0), tokens(0), maxTokens(0), maxDepth(0) {}
+
+        void expand(size_t prod, size_t cell) {
+          add(prods[prod], 1);
+          add(cells[cell], 1);
+        }
+
+        void sentence(bool valid, size_t words, size_t depth) {
+          add(sentences, 1);
+          add(accepted, valid);
+          add(tokens, words);
+          raise(maxTokens, words);
+          raise(maxDepth, depth);
+        }
+    };
+
+  private:
+    std::vector<std::string> prodNames, varNames, termNames;
+    uint64_t id; // Never reused, so the caches never match a dead profile
+    mutable std::mutex lock; // Taken to find or add the counters of a thread
+    std::map<std::thread::id, std::unique_ptr<Counters>> threads;
+
+    static uint64_t newId() {
+      static std::atomic<uint64_t> next(1);
+      return next++;
+    }
+
+    /* Sorts from the highest count down, the ones never counted are left
+     * out */
+    static std::vector<std::pair<std::string, uint64_t>> sorted(
+      const std::vector<std::string> &names,
+      const std::vector<uint64_t> &counts) {
+      std::vector<std::pair<std::string, uint64_t>> list;
+      std::vector<size_t> order;
+
+      for (size_t i = 0; i < counts.size(); i++)
+        if (counts[i] > 0) order.push_back(i);
+      std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return counts[a] > counts[b];
+      });
+      for (const size_t i : order)
+        list.push_back(std::make_pair(names[i], counts[i]));
+      return list;
+    }
+
+  public:
+    /* Names of the productions by id, of the variables and of the terminals
+     * with "$" as the last one. Cell (v, t) is v * terminals + t. */
+    RecognitionProfile(const std::vector<std::string> &prods_,
+      const std::vector<std::string> &vars_,
+      const std::vector<std::string> &terms_) :
+      prodNames(prods_), varNames(vars_), termNames(terms_), id(newId()) {}
+
+    /* Counters of the calling thread */
+    Counters & local() {
+      struct Slot { uint64_t id; Counters *counters; };
+      thread_local Slot cache[PROFILE_THREAD_CACHE] = {};
+      thread_local size_t next = 0;
+
+      for (const Slot &slot : cache)
+        if (slot.id == id) return *slot.counters;
+
+      // The thread may have left the cache with counters of its own
+      Counters *counters;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        std::unique_ptr<Counters> &mine = threads[std::this_thread::get_id()];
+        if (mine == nullptr)
+          mine.reset(new Counters(prodNames.size(),
+            varNames.size() * termNames.size()));
+        counters = mine.get();
+      }
+      cache[next++ % PROFILE_THREAD_CACHE] = Slot{id, counters};
+      return *counters;
+    }
+
+    /* Threads that have counters in the profile */
+    size_t threadCount() const {
+      std::lock_guard<std::mutex> guard(lock);
+      return threads.size();
+    }
+
+    /* Adds the counters of every thread */
+    ProfileSummary summary() const {
+      const size_t ncells = varNames.size() * termNames.size();
+      std::vector<uint64_t> prods(prodNames.size(), 0), cells(ncells, 0);
+      std::vector<std::string> cellNames(ncells);
+      ProfileSummary total{0, 0, 0, 0, 0, {}, {}};
+
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        for (const auto &thread : threads) {
+          const std::unique_ptr<Counters> &counters = thread.second;
+          for (size_t p = 0; p < prods.size(); p++)
+            prods[p] += counters->prods[p];
+          for (size_t c = 0; c < ncells; c++)
+            cells[c] += counters->cells[c];
+          total.sentences += counters->sentences;
+          total.accepted += counters->accepted;
+          total.tokens += counters->tokens;
+          total.maxTokens = std::max<uint64_t>(total.maxTokens,
+            counters->maxTokens);
+          total.maxDepth = std::max<uint64_t>(total.maxDepth,
+            counters->maxDepth);
+        }
+      }
+      for (size_t c = 0; c < ncells; c++)
+        if (cells[c] > 0)
+          cellNames[c] = varNames[c / termNames.size()] + ", " +
+            termNames[c % termNames.size()];
+      total.productions = sorted(prodNames, prods);
+      total.cells = sorted(cellNames, cells);
+      return total;
+    }
+
+    /* Summary as text, with at most limit productions and cells (0 shows
+     * all of them) */
+    std::string report(size_t limit = 0) const {
+      ProfileSummary total = summary();
+      char line[128];
+      std::string str;
+
+      snprintf(line, sizeof(line), "%-12s %llu (%llu accepted)\n",
+        "sentences", (unsigned long long)total.sentences,
+        (unsigned long long)total.accepted);
+      str.append(line);
+      snprintf(line, sizeof(line), "%-12s %llu (%.1f by sentence, max %llu)\n",
+        "tokens", (unsigned long long)total.tokens, (total.sentences == 0)?
+        0.0 : (double)total.tokens / total.sentences,
+        (unsigned long long)total.maxTokens);
+      str.append(line);
+      snprintf(line, sizeof(line), "%-12s %llu\n", "max depth",
+        (unsigned long long)total.maxDepth);
+      str.append(line);
+
+      const std::vector<std::pair<std::string, uint64_t>> *lists[2] =
+        {&total.productions, &total.cells};
+      const char *titles[2] = {"production", "cell"};
+      for (size_t l = 0; l < 2; l++) {
+        snprintf(line, sizeof(line), "\n%-12s %s\n", "expansions", titles[l]);
+        str.append(line);
+        for (size_t i = 0; i < lists[l]->size() && (limit == 0 || i < limit);
+            i++) {
+          snprintf(line, sizeof(line), "%-12llu ",
+            (unsigned long long)(*lists[l])[i].second);
+          str.append(line);
+          str.append((*lists[l])[i].first);
+          str.append("\n");
+        }
+      }
+      return str;
+    }
+};
+
+#endif
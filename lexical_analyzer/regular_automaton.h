@@ -0,0 +1,277 @@
+#ifndef regular_automaton
+#define regular_automaton
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "analysis_control.h"
+#include "production_set.h"
+
+#define REGULAR_EPSILON "''"
+#define REGULAR_MAX_STATES 4096
+#define REGULAR_MAX_CELLS (1 << 20) // States by terminals of the DFA
+
+/* Minimal DFA of a right linear (A -> w B, A -> w) or left linear
+ * (A -> B w, A -> w) grammar, where w is a string of terminals. The grammar
+ * is turned into an NFA with one state per variable, the NFA is determinized
+ * with the subset construction and the DFA is minimized with Hopcroft's
+ * algorithm. A string is then read with one table lookup per
+ * word and no stack, whether the grammar is LL(1) or not. */
+class RegularAutomaton {
+  private:
+    typedef std::vector<std::vector<std::pair<int, size_t>>> Moves;
+
+    size_t nsyms; // Terminals without "$"
+    int start;    // -1 if the grammar is not regular
+    std::vector<int> table; // Next state by state and terminal, or -1
+    std::vector<bool> accepting; // By state
+
+    /* Adds the states that the NFA reaches with EPSILON and sorts them. mark
+     * has a stamp by NFA state, a new stamp is taken on every call. */
+    static void closure(const Moves &moves, std::vector<size_t> &states,
+      std::vector<size_t> &mark, size_t &stamp) {
+      stamp++;
+      for (const size_t s : states) mark[s] = stamp;
+      for (size_t i = 0; i < states.size(); i++)
+        for (const std::pair<int, size_t> &move : moves[states[i]])
+          if (move.first < 0 && mark[move.second] != stamp) {
+            mark[move.second] = stamp;
+            states.push_back(move.second);
+          }
+      std::sort(states.begin(), states.end());
+      states.erase(std::unique(states.begin(), states.end()), states.end());
+    }
+
+    /* Splits the states of a complete DFA in blocks of equivalent states
+     * (Hopcroft). Every block is split by the states that go into another
+     * one with a terminal, and only the smaller half of a split is used to
+     * split again. Returns the block of each state, or an empty vector if
+     * the control stopped it. */
+    std::vector<size_t> minimize(const std::vector<int> &dfa,
+      const std::vector<bool> &accept, const AnalysisControl *control) const {
+      const size_t n = accept.size(), k = nsyms;
+      std::vector<size_t> predOffset(n * k + 1, 0), pred(n * k);
+      std::vector<size_t> elems, where(n), block(n, 0), first, last, marked;
+      std::vector<std::pair<size_t, size_t>> work; // Block and terminal
+      std::vector<bool> waiting;
+      std::vector<size_t> splitters, touched;
+
+      // States that go to each state with each terminal
+      for (size_t s = 0; s < n * k; s++) predOffset[dfa[s] * k + s % k + 1]++;
+      for (size_t i = 1; i <= n * k; i++) predOffset[i] += predOffset[i-1];
+      std::vector<size_t> fill(predOffset.begin(), predOffset.end() - 1);
+      for (size_t s = 0; s < n * k; s++)
+        pred[fill[dfa[s] * k + s % k]++] = s / k;
+
+      // Final and other states
+      for (size_t s = 0; s < n; s++) if (accept[s]) elems.push_back(s);
+      first.push_back(0); last.push_back(elems.size());
+      for (size_t s = 0; s < n; s++) if (!accept[s]) elems.push_back(s);
+      if (last[0] == 0 || last[0] == n) { last[0] = n; }
+      else { first.push_back(last[0]); last.push_back(n); }
+      for (size_t i = 0; i < n; i++) {
+        where[elems[i]] = i;
+        block[elems[i]] = (i < last[0])? 0 : 1;
+      }
+      marked.assign(first.size(), 0);
+      waiting.assign(first.size() * k, false);
+      if (first.size() == 2) {
+        size_t b = (last[0] - first[0] <= last[1] - first[1])? 0 : 1;
+        for (size_t a = 0; a < k; a++) {
+          work.push_back(std::make_pair(b, a));
+          waiting[b * k + a] = true;
+        }
+      }
+
+      for (size_t steps = 0; !work.empty(); steps++) {
+        if ((steps & 255) == 255 && control != NULL && control->stop())
+          return std::vector<size_t>();
+        const size_t b = work.back().first, a = work.back().second;
+        work.pop_back();
+        waiting[b * k + a] = false;
+
+        splitters.clear();
+        for (size_t i = first[b]; i < last[b]; i++) {
+          size_t q = elems[i] * k + a;
+          splitters.insert(splitters.end(), pred.begin() + predOffset[q],
+            pred.begin() + predOffset[q+1]);
+        }
+
+        // Move the splitters to the front of their blocks
+        touched.clear();
+        for (const size_t p : splitters) {
+          size_t y = block[p], to = first[y] + marked[y]++;
+          if (marked[y] == 1) touched.push_back(y);
+          where[elems[to]] = where[p];
+          std::swap(elems[to], elems[where[p]]);
+          where[p] = to;
+        }
+
+        for (const size_t y : touched) {
+          size_t z = first.size();
+          if (marked[y] == last[y] - first[y]) { marked[y] = 0; continue; }
+          first.push_back(first[y]);
+          last.push_back(first[y] + marked[y]);
+          marked.push_back(0);
+          first[y] += marked[y];
+          marked[y] = 0;
+          for (size_t i = first[z]; i < last[z]; i++) block[elems[i]] = z;
+
+          waiting.resize(first.size() * k, false);
+          bool smaller = last[z] - first[z] <= last[y] - first[y];
+          for (size_t c = 0; c < k; c++) {
+            size_t add = (waiting[y * k + c] || smaller)? z : y;
+            work.push_back(std::make_pair(add, c));
+            waiting[add * k + c] = true;
+          }
+        }
+      }
+      return block;
+    }
+
+  public:
+    RegularAutomaton() { nsyms = 0; start = -1; }
+
+    /* Builds the minimal DFA of the productions. The ids of the variables
+     * must be the ones used to index the ProductionSet and termIds must give
+     * the ids 0..nterms-1 with "$" as the last one. Returns false if the
+     * grammar is neither right nor left linear, the DFA has more than
+     * REGULAR_MAX_STATES states or REGULAR_MAX_CELLS cells, or the control
+     * stopped it. */
+    bool compile(const ProductionSet &prods,
+      const std::map<std::string, size_t> &varIds, size_t nvars,
+      const std::map<std::string, size_t> &termIds, size_t nterms,
+      const AnalysisControl *control = NULL) {
+      std::map<std::string, size_t>::const_iterator it;
+      std::vector<int> syms;
+      std::vector<size_t> offsets(1, 0);
+      bool right = true, left = true;
+
+      nsyms = nterms - 1;
+      start = -1;
+      table.clear();
+      accepting.clear();
+      if (prods.empty()) return false;
+
+      // Encode the productions, at most one variable at an end
+      for (size_t p = 0; p < prods.size(); p++) {
+        size_t nvar = 0;
+        for (const std::string &elem : prods.elements(p)) {
+          if (elem.compare(REGULAR_EPSILON) == 0) continue;
+          if ((it = varIds.find(elem)) != varIds.end()) {
+            if (++nvar > 1) return false;
+            left = left && syms.size() == offsets.back();
+            syms.push_back(-1 - (int)it->second);
+          } else {
+            right = right && nvar == 0;
+            syms.push_back(termIds.at(elem));
+          }
+        }
+        if (!right && !left) return false;
+        offsets.push_back(syms.size());
+      }
+
+      // NFA: a state by variable, one more for the end (right linear) or the
+      // beginning (left linear) and the ones inside strings of terminals
+      Moves moves(nvars + 1);
+      const size_t other = nvars, head = varIds.at(prods.variable(0));
+      for (size_t p = 0; p < prods.size(); p++) {
+        size_t from = varIds.at(prods.variable(p)), to = from;
+        const int *b = syms.data() + offsets[p];
+        size_t n = offsets[p+1] - offsets[p];
+
+        if (right) {
+          if (n > 0 && b[n-1] < 0) to = -1 - b[--n];
+          else to = other;
+        } else {
+          if (n > 0 && b[0] < 0) { from = -1 - b[0]; b++; n--; }
+          else from = other;
+        }
+        if (n == 0) moves[from].push_back(std::make_pair(-1, to));
+        for (size_t i = 0; i < n; i++) {
+          size_t inner = to;
+          if (i + 1 < n) { inner = moves.size(); moves.emplace_back(); }
+          moves[from].push_back(std::make_pair(b[i], inner));
+          from = inner;
+        }
+      }
+      const size_t nfaStart = (right)? head : other;
+      const size_t nfaFinal = (right)? other : head;
+
+      // Subset construction, state 0 is the start
+      std::map<std::vector<size_t>, size_t> ids;
+      std::vector<std::vector<size_t>> subsets(1, {nfaStart});
+      std::vector<std::vector<size_t>> targets(nsyms);
+      std::vector<int> dfa;
+      std::vector<bool> accept;
+      std::vector<size_t> mark(moves.size(), 0);
+      size_t stamp = 0;
+      closure(moves, subsets[0], mark, stamp);
+      ids[subsets[0]] = 0;
+      for (size_t d = 0; d < subsets.size(); d++) {
+        if (subsets.size() > REGULAR_MAX_STATES ||
+            (subsets.size() + 1) * nsyms > REGULAR_MAX_CELLS) return false;
+        if (control != NULL && control->stop()) return false;
+        for (std::vector<size_t> &target : targets) target.clear();
+        accept.push_back(false);
+        for (const size_t s : subsets[d]) {
+          if (s == nfaFinal) accept.back() = true;
+          for (const std::pair<int, size_t> &move : moves[s])
+            if (move.first >= 0) targets[move.first].push_back(move.second);
+        }
+        for (size_t a = 0; a < nsyms; a++) {
+          if (targets[a].empty()) { dfa.push_back(-1); continue; }
+          closure(moves, targets[a], mark, stamp);
+          std::pair<std::map<std::vector<size_t>, size_t>::iterator, bool> id =
+            ids.emplace(targets[a], subsets.size());
+          if (id.second) subsets.push_back(targets[a]);
+          dfa.push_back(id.first->second);
+        }
+      }
+
+      // Minimize with a dead state at the end for the missing moves
+      const size_t dead = accept.size();
+      accept.push_back(false);
+      dfa.resize(accept.size() * nsyms, dead);
+      for (int &target : dfa) if (target < 0) target = dead;
+      std::vector<size_t> cls = minimize(dfa, accept, control);
+      if (cls.empty()) return false;
+
+      // Number the classes from the start one, the dead one has no state
+      std::vector<int> state(accept.size(), -1);
+      std::vector<size_t> order(1, 0);
+      state[cls[0]] = 0;
+      for (size_t i = 0; i < order.size(); i++)
+        for (size_t a = 0; a < nsyms; a++) {
+          size_t c = cls[dfa[order[i] * nsyms + a]];
+          if (state[c] == -1 && (c != cls[dead] || c == cls[0])) {
+            state[c] = order.size();
+            order.push_back(dfa[order[i] * nsyms + a]);
+          }
+        }
+      table.assign(order.size() * nsyms, -1);
+      accepting.assign(order.size(), false);
+      for (size_t i = 0; i < order.size(); i++) {
+        accepting[i] = accept[order[i]];
+        for (size_t a = 0; a < nsyms; a++)
+          table[i * nsyms + a] = state[cls[dfa[order[i] * nsyms + a]]];
+      }
+      start = 0;
+      return true;
+    }
+
+    /* First state, or -1 if nothing was compiled */
+    int initial() const { return start; }
+
+    /* State after reading the terminal, or -1 if no string goes on with it */
+    int next(int state, int term) const { return table[state * nsyms + term]; }
+
+    bool isFinal(int state) const { return accepting[state]; }
+
+    /* States of the minimal DFA */
+    size_t size() const { return accepting.size(); }
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef result_cache
+#define result_cache
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#define RESULT_CACHE_SHARDS 16
+#define RESULT_NO_POSITION ((size_t)-1)
+
+/* Result of recognizing a string: if it was accepted and, if it was not, the
+ * word where the recognizer stopped (the number of words if the string ended
+ * too soon) and the ids of the terminals that could have been there. */
+struct CachedResult {
+  bool valid;
+  size_t position; // RESULT_NO_POSITION if the recognizer can not tell
+  std::vector<int> expected;
+};
+
+/* Bounded cache of the results of strings of a grammar, addressed by a hash
+ * of their terminal ids and the version of the grammar. It is split in
+ * shards, each one a least recently used list with its own lock, so threads
+ * that look up different strings rarely wait for each other. The ids are
+ * kept to tell apart hash collisions. */
+class ResultCache {
+  private:
+    struct Entry {
+      uint64_t key;
+      int ver;
+      std::vector<int> ids;
+      CachedResult result;
+    };
+
+    struct Shard {
+      std::mutex lock;
+      std::list<Entry> entries; // Most recently used first
+      std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    };
+
+    size_t capacity, perShard;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<size_t> hits, misses;
+
+    /* Maps the high bits of the key to a shard without a division */
+    Shard & shardOf(uint64_t key) const {
+      return *shards[((key >> 32) * shards.size()) >> 32];
+    }
+
+  public:
+    ResultCache(size_t capacity_, size_t nshards = RESULT_CACHE_SHARDS) :
+      capacity(capacity_), hits(0), misses(0) {
+      if (nshards == 0) nshards = 1;
+      if (capacity < nshards) capacity = nshards;
+      perShard = (capacity + nshards - 1) / nshards;
+      for (size_t s = 0; s < nshards; s++) shards.emplace_back(new Shard());
+    }
+
+    /* Hash of a string of terminal ids of a version of the grammar */
+    static uint64_t hash(const std::vector<int> &ids, int ver) {
+      uint64_t h = 0x9e3779b97f4a7c15ULL ^ (uint32_t)ver;
+      for (const int id : ids) {
+        h = (h ^ (uint32_t)id) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 29;
+      }
+      h ^= ids.size();
+      h *= 0xc4ceb9fe1a85ec53ULL;
+      return h ^ (h >> 32);
+    }
+
+    /* Copies the result of the ids to result if it is in the cache */
+    bool find(uint64_t key, const std::vector<int> &ids, int ver,
+      CachedResult &result) {
+      Shard &shard = shardOf(key);
+      std::lock_guard<std::mutex> guard(shard.lock);
+
+      auto it = shard.index.find(key);
+      if (it == shard.index.end() || it->second->ver != ver ||
+          it->second->ids != ids) {
+        misses++;
+        return false;
+      }
+      shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+      result = shard.entries.front().result;
+      hits++;
+      return true;
+    }
+
+    /* Stores the result of the ids. A collision replaces the older string and
+     * a full shard drops its least recently used one. */
+    void insert(uint64_t key, const std::vector<int> &ids, int ver,
+      const CachedResult &result) {
+      Shard &shard = shardOf(key);
+      std::lock_guard<std::mutex> guard(shard.lock);
+
+      auto it = shard.index.find(key);
+      if (it != shard.index.end()) {
+        shard.entries.erase(it->second);
+        shard.index.erase(it);
+      }
+      shard.entries.push_front(Entry{key, ver, ids, result});
+      shard.index[key] = shard.entries.begin();
+      if (shard.entries.size() > perShard) {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+      }
+    }
+
+    void clear() {
+      for (std::unique_ptr<Shard> &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->entries.clear();
+        shard->index.clear();
+      }
+    }
+
+    size_t size() const {
+      size_t n = 0;
+      for (const std::unique_ptr<Shard> &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        n += shard->entries.size();
+      }
+      return n;
+    }
+
+    size_t getCapacity() const { return capacity; }
+
+    size_t getShards() const { return shards.size(); }
+
+    size_t getHits() const { return hits; }
+
+    size_t getMisses() const { return misses; }
+};
+
+#endif
@@ -0,0 +1,39 @@
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include "../batch_analysis.h"
+
+/* Analyzes many grammar files in one process and writes one JSON document,
+ * see batch_analysis.h for its format. The argument is a directory, whose
+ * regular files are analyzed in name order, or a manifest with one path by
+ * line. */
+
+int main(int argc, char *argv[]) {
+    size_t nthreads = std::thread::hardware_concurrency();
+    std::vector<std::string> files;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:")) != -1) {
+      if (opt != 'j' || atoi(optarg) <= 0) {
+        fprintf(stderr, "usage: %s [-j threads] <directory | manifest>\n",
+          argv[0]);
+        return -3;
+      }
+      nthreads = atoi(optarg);
+    }
+    if (optind + 1 != argc) {
+      fprintf(stderr, "usage: %s [-j threads] <directory | manifest>\n",
+        argv[0]);
+      return -3;
+    }
+    if (!listGrammarFiles(argv[optind], files)) {
+      fprintf(stderr, "Could not read %s\n", argv[optind]);
+      return -1;
+    }
+
+    BufferedWriter out(stdout);
+    analyzeGrammarFiles(files, nthreads, out);
+    out.flush();
+    return 0;
+}
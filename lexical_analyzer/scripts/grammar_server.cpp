@@ -0,0 +1,171 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "../grammar_cache.h"
+
+#define MAX_LINE_LEN 4096
+#define DEFAULT_CAPACITY 64
+
+/* Line protocol, one request per line and one answer per request:
+ *   GRAMMAR <n>               followed by n rules
+ *                             => OK <key> <LL|NOTLL> <HIT|MISS>
+ *   VALID <key> <sentence>    => YES | NO
+ *   FIRST <key> <symbol>      => OK <terminals>
+ *   FOLLOW <key> <variable>   => OK <terminals>
+ *   PROD <key> <var> <term>   => OK <production>
+ *   STATS                     => OK <size> <capacity> <hits> <misses>
+ *   QUIT                      => closes the connection
+ * Errors are answered with ERR <reason>. */
+
+/* Reads a line without its '\n'. A line that does not fit in MAX_LINE_LEN
+ * is read to its end and too_long is set, so its tail is never taken as
+ * another request. */
+bool scan_line(FILE *in, std::string &line, bool &too_long) {
+    char str[MAX_LINE_LEN];
+    size_t len;
+    int c;
+
+    too_long = false;
+    if (fgets(str, MAX_LINE_LEN, in) == NULL) return false;
+    len = strlen(str);
+    if (len > 0 && str[len-1] == '\n') str[--len] = '\0';
+    else if (len == MAX_LINE_LEN - 1 && (c = fgetc(in)) != EOF && c != '\n') {
+      while ((c = fgetc(in)) != EOF && c != '\n');
+      too_long = true;
+    }
+    line = std::string(str, len);
+    return true;
+}
+
+void print_list(FILE *out, const std::list<std::string> &list) {
+    fprintf(out, "OK");
+    for (const std::string &elem : list) fprintf(out, " %s", elem.c_str());
+    fprintf(out, "\n");
+}
+
+/* Answers the requests of a client until it quits or closes the stream */
+void serve(GrammarCache &cache, FILE *in, FILE *out) {
+    std::string line, command, rest;
+    std::shared_ptr<LexicalAnalyzer> analyzer;
+    uint64_t key;
+    bool cached, too_long;
+    size_t pos;
+
+    while (scan_line(in, line, too_long)) {
+      if (too_long) {
+        fprintf(out, "ERR Line longer than %d bytes\n", MAX_LINE_LEN - 1);
+        fflush(out);
+        continue;
+      }
+      pos = line.find(' ');
+      command = line.substr(0, pos);
+      rest = (pos == std::string::npos)? "" : line.substr(pos + 1);
+
+      if (command == "QUIT") break;
+
+      if (command == "GRAMMAR") {
+        std::list<std::string> rules;
+        int nrules = atoi(rest.c_str());
+        bool rule_too_long = false;
+        for (int i = 0; i < nrules && scan_line(in, line, too_long); i++) {
+          rule_too_long |= too_long;
+          rules.push_back(line);
+        }
+
+        if (rule_too_long)
+          fprintf(out, "ERR Rule longer than %d bytes\n", MAX_LINE_LEN - 1);
+        else if ((analyzer = cache.get(rules, key, cached)) == nullptr)
+          fprintf(out, "ERR Syntax for the rules was rejected!\n");
+        else
+          fprintf(out, "OK %016llx %s %s\n", (unsigned long long)key,
+            (analyzer->is_ll())? "LL" : "NOTLL", (cached)? "HIT" : "MISS");
+      } else if (command == "STATS") {
+        fprintf(out, "OK %zu %zu %zu %zu\n", cache.size(),
+          cache.getCapacity(), cache.getHits(), cache.getMisses());
+      } else if (command == "VALID" || command == "FIRST" ||
+          command == "FOLLOW" || command == "PROD") {
+        // Every query starts with the key of the grammar
+        pos = rest.find(' ');
+        key = strtoull(rest.substr(0, pos).c_str(), NULL, 16);
+        rest = (pos == std::string::npos)? "" : rest.substr(pos + 1);
+
+        if ((analyzer = cache.find(key)) == nullptr) {
+          fprintf(out, "ERR Unknown grammar, send it again\n");
+        } else if (command == "VALID") {
+          fprintf(out, "%s\n", (analyzer->validStr(rest))? "YES" : "NO");
+        } else {
+          try {
+            if (command == "FIRST") print_list(out, analyzer->getFirst(rest));
+            else if (command == "FOLLOW")
+              print_list(out, analyzer->getFollow(rest));
+            else {
+              pos = rest.find(' ');
+              fprintf(out, "OK %s\n", analyzer->getProd(rest.substr(0, pos),
+                (pos == std::string::npos)? "" : rest.substr(pos+1)).c_str());
+            }
+          } catch (const std::exception &e) {
+            fprintf(out, "ERR %s\n", e.what());
+          }
+        }
+      } else {
+        fprintf(out, "ERR Unknown command %s\n", command.c_str());
+      }
+      fflush(out);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *socketPath = NULL;
+    size_t capacity = DEFAULT_CAPACITY;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:c:")) != -1) {
+      switch (opt) {
+        case 's': socketPath = optarg; break;
+        case 'c': capacity = strtoul(optarg, NULL, 10); break;
+        default:
+          fprintf(stderr, "usage: %s [-c cache capacity] [-s socket path]\n",
+            argv[0]);
+          return -1;
+      }
+    }
+
+    GrammarCache cache(capacity);
+
+    // Without a socket it serves a single client through stdin and stdout
+    if (socketPath == NULL) {
+      serve(cache, stdin, stdout);
+      return 0;
+    }
+
+    struct sockaddr_un addr;
+    int server, client;
+
+    if ((server = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+      fprintf(stderr, "Could not create socket.\n");
+      return -2;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+    unlink(socketPath);
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(server, 16) < 0) {
+      fprintf(stderr, "Could not listen on %s.\n", socketPath);
+      return -3;
+    }
+
+    // Clients are served one after the other and share the cache
+    while ((client = accept(server, NULL, NULL)) >= 0) {
+      FILE *in = fdopen(client, "r"), *out = fdopen(dup(client), "w");
+      if (in != NULL && out != NULL) serve(cache, in, out);
+      if (in != NULL) fclose(in);
+      if (out != NULL) fclose(out);
+    }
+
+    close(server);
+    return 0;
+}
@@ -1,5 +1,7 @@
+#include <cstring>
 #include <iostream>
-#include "../lexical_analyzer.h"
+#include <unistd.h>
+#include "../table_exporter.h"
 
 #define MAX_RULE_LEN 256
 
@@ -12,13 +14,23 @@ std::string scan_line() {
 }
 
 int main(int argc, char *argv[]) {
-    int nrules, ntests;
+    int nrules, ntests, opt;
     std::list<std::string> rules, tests;
-    FILE *html, *log = NULL;
+    FILE *table, *log = NULL;
+    TableFormat format = TableFormat::HTML;
+
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+      if (opt != 'f' || !TableExporter::parseFormat(optarg, format)) {
+        fprintf(stderr, "Formats: html, csv, json, md\n");
+        return -3;
+      }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
 
     if (argc == 2 || argc == 3) {
-      if( (html = fopen(argv[1], "w")) == NULL) {
-        fprintf(stderr, "Could not open file to write HTML.\n");
+      if( (table = fopen(argv[1], "w")) == NULL) {
+        fprintf(stderr, "Could not open file to write the table.\n");
         return -1;
       }
 
@@ -28,7 +40,8 @@ int main(int argc, char *argv[]) {
           return -2;
         }
     } else {
-      fprintf(stderr, "usage: %s <HTML file destination>\n", argv[0]);
+      fprintf(stderr, "usage: %s [-f html|csv|json|md] <table destination> "
+        "[log destination]\n", argv[0]);
       return -3;
     }
 
@@ -48,36 +61,30 @@ int main(int argc, char *argv[]) {
       return -4;
     }
 
-    // Set headers
-    fprintf(html, "<table>\n\t<tr>\n");
-    fprintf(html, "\t\t<th>No Terminal</th>\n");
-    for (const std::string t : analyzer.getTerminals())
-      fprintf(html, "\t\t<th>%s</th>\n", t.c_str());
-    fprintf(html, "\t</tr>\n");
-
     // Build table
-    for (const std::string var : analyzer.getVariables()) {
-      fprintf(html, "\t<tr>\n");
-      for (const std::string t : analyzer.getTerminals())
-        fprintf(html, "\t\t<td>%s</td>\n", analyzer.getProd(var, t).c_str());
-      fprintf(html, "\t</tr>\n");
-    }
-    fprintf(html, "</table>\n");
+    BufferedWriter out(table);
+    TableExporter(format).write(analyzer, out);
 
     // Scan tests
     for (int i = 0; i < ntests; i++) tests.push_back(std::string(scan_line()));
 
-    // Run tests
+    // Run tests, only the HTML file has room for them
     int i = 1;
+    char line[64];
     for (const std::string test : tests) {
-      fprintf(html, "<p>Input #%i: ", i);
-      (analyzer.validStr(test))?
-        fprintf(html, "Yes</p>\n"):
-        fprintf(html, "No</p>\n");
+      if (format == TableFormat::HTML) {
+        snprintf(line, sizeof(line), "<p>Input #%i: %s</p>\n", i,
+          (analyzer.validStr(test))? "Yes" : "No");
+        out.write(line);
+      } else {
+        fprintf(stdout, "Input #%i: %s\n", i,
+          (analyzer.validStr(test))? "Yes" : "No");
+      }
       i++;
     }
+    out.flush();
 
-    fclose(html);
+    fclose(table);
     if(log != NULL) fclose(log);
     return 0;
 }
@@ -0,0 +1,74 @@
+#ifndef small_stack
+#define small_stack
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+/* Stack that keeps its first N values inside the object and only goes to
+ * the heap when it grows past them. Parse stacks are usually shallow so most
+ * parses never allocate. */
+template <typename T, size_t N = 64>
+class SmallStack {
+  private:
+    alignas(T) unsigned char local[N * sizeof(T)];
+    T *data;
+    size_t count, capacity;
+
+    void grow() {
+      T *bigger = static_cast<T *>(::operator new(2 * capacity * sizeof(T)));
+      for (size_t i = 0; i < count; i++) {
+        new (bigger + i) T(std::move(data[i]));
+        data[i].~T();
+      }
+      if (data != reinterpret_cast<T *>(local)) ::operator delete(data);
+      data = bigger;
+      capacity *= 2;
+    }
+
+  public:
+    SmallStack() : data(reinterpret_cast<T *>(local)), count(0), capacity(N) {}
+
+    ~SmallStack() {
+      clear();
+      if (data != reinterpret_cast<T *>(local)) ::operator delete(data);
+    }
+
+    SmallStack(const SmallStack &) = delete;
+
+    SmallStack & operator = (const SmallStack &) = delete;
+
+    void push(const T &value) {
+      if (count == capacity) grow();
+      new (data + count++) T(value);
+    }
+
+    void push(T &&value) {
+      if (count == capacity) grow();
+      new (data + count++) T(std::move(value));
+    }
+
+    void pop() { data[--count].~T(); }
+
+    /* Removes the last n values */
+    void pop(size_t n) { while (n-- > 0) pop(); }
+
+    void clear() { pop(count); }
+
+    T & top() { return data[count - 1]; }
+
+    const T & top() const { return data[count - 1]; }
+
+    /* Pointer to the last n values, the oldest first */
+    T * last(size_t n) { return data + count - n; }
+
+    T & operator [] (size_t i) { return data[i]; }
+
+    const T & operator [] (size_t i) const { return data[i]; }
+
+    size_t size() const { return count; }
+
+    bool empty() const { return count == 0; }
+};
+
+#endif
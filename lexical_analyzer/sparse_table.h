@@ -0,0 +1,92 @@
+#ifndef sparse_table
+#define sparse_table
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "memory_account.h"
+
+/* Table of ints stored by rows as a default value plus the cells that differ
+ * from it. Every row has a bitmap of its exceptions and every word of the
+ * bitmaps knows where its first exception is, so a cell costs one bitmap
+ * read and a popcount, and a row that is mostly empty or mostly one value
+ * uses a few words instead of one int per column. */
+class SparseTable {
+  private:
+    size_t ncols, nwords; // Words of bitmap by row
+    CountedVector<uint64_t> bits;  // Exceptions of each row
+    CountedVector<uint32_t> rank;  // Index in values of the first exception
+                                   // of each word
+    CountedVector<uint32_t> base;  // Index in values of the default of a row
+    CountedVector<int> values;     // Default and exceptions of each row
+
+  public:
+    /* The arrays are charged to the allocator's account, if it has one */
+    SparseTable(
+      const CountingAllocator<char> &alloc = CountingAllocator<char>()) :
+      bits(alloc), rank(alloc), base(alloc), values(alloc) {
+      ncols = 0; nwords = 0;
+    }
+
+    /* Removes every row and frees the memory, the next rows have ncols_
+     * columns */
+    void clear(size_t ncols_ = 0) {
+      ncols = ncols_;
+      nwords = (ncols + 63) / 64;
+      CountedVector<uint64_t>(bits.get_allocator()).swap(bits);
+      CountedVector<uint32_t>(rank.get_allocator()).swap(rank);
+      CountedVector<uint32_t>(base.get_allocator()).swap(base);
+      CountedVector<int>(values.get_allocator()).swap(values);
+    }
+
+    /* Adds a row with the ncols cells. The default is its most common
+     * value. */
+    void addRow(const int *cells) {
+      std::vector<int> sorted(cells, cells + ncols);
+      int common = -1;
+      size_t best = 0;
+
+      std::sort(sorted.begin(), sorted.end());
+      for (size_t i = 0, j; i < sorted.size(); i = j) {
+        for (j = i; j < sorted.size() && sorted[j] == sorted[i]; j++);
+        if (j - i > best) { best = j - i; common = sorted[i]; }
+      }
+
+      base.push_back(values.size());
+      values.push_back(common);
+      for (size_t w = 0; w < nwords; w++) {
+        uint64_t word = 0;
+        rank.push_back(values.size());
+        for (size_t c = w * 64; c < ncols && c < (w + 1) * 64; c++)
+          if (cells[c] != common) {
+            word |= (uint64_t)1 << (c & 63);
+            values.push_back(cells[c]);
+          }
+        bits.push_back(word);
+      }
+    }
+
+    int get(size_t row, size_t col) const {
+      const size_t w = row * nwords + (col >> 6);
+      const uint64_t word = bits[w];
+      const uint64_t below = word & (((uint64_t)1 << (col & 63)) - 1);
+      const size_t exception = rank[w] + __builtin_popcountll(below);
+      return values[((word >> (col & 63)) & 1)? exception : base[row]];
+    }
+
+    size_t rows() const { return base.size(); }
+
+    size_t cols() const { return ncols; }
+
+    /* Cells that are not the default of their row */
+    size_t exceptions() const { return values.size() - base.size(); }
+
+    /* Bytes used by the arrays */
+    size_t bytes() const {
+      return bits.size() * sizeof(uint64_t) + rank.size() * sizeof(uint32_t) +
+        base.size() * sizeof(uint32_t) + values.size() * sizeof(int);
+    }
+};
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef symbol_sets
+#define symbol_sets
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "memory_account.h"
+#include "production_set.h"
+#include "thread_pool.h"
+
+/* Set of terminal ids stored as a bitset */
+class TermSet {
+  private:
+    CountedVector<uint64_t> words;
+
+  public:
+    TermSet() {}
+
+    TermSet(size_t nterms,
+      const CountingAllocator<uint64_t> &alloc = CountingAllocator<uint64_t>()) :
+      words((nterms + 63) / 64, 0, alloc) {}
+
+    void insert(size_t t) { words[t >> 6] |= (uint64_t)1 << (t & 63); }
+
+    bool has(size_t t) const { return (words[t >> 6] >> (t & 63)) & 1; }
+
+    /* Adds every element of the other set. Returns if something was added. */
+    bool merge(const TermSet &other) {
+      uint64_t added = 0;
+      for (size_t i = 0; i < words.size(); i++) {
+        added |= other.words[i] & ~words[i];
+        words[i] |= other.words[i];
+      }
+      return added != 0;
+    }
+
+    bool intersects(const TermSet &other) const {
+      for (size_t i = 0; i < words.size(); i++)
+        if (words[i] & other.words[i]) return true;
+      return false;
+    }
+
+    /* Calls fn with every terminal id of the set in increasing order */
+    template <typename Fn>
+    void forEach(Fn fn) const {
+      for (size_t i = 0; i < words.size(); i++)
+        for (uint64_t w = words[i]; w; w &= w - 1)
+          fn(i * 64 + __builtin_ctzll(w));
+    }
+};
+
+/* Directed graph where an edge from u to v means that u needs the value of
+ * v. It is split in strongly connected components so every component can be
+ * solved once all the components it needs are done. */
+class DependencyGraph {
+  private:
+    size_t nnodes;
+    std::vector<std::pair<size_t, size_t>> edges;
+
+    std::vector<size_t> component;  // Component of each node
+    std::vector<size_t> memberOffsets, members; // Nodes of each component
+    std::vector<size_t> dependentOffsets, dependents; // Components that need it
+    std::vector<size_t> ndependencies; // Components it needs
+
+  public:
+    DependencyGraph(size_t nnodes_) : nnodes(nnodes_) {}
+
+    void addEdge(size_t u, size_t v) { edges.push_back(std::make_pair(u, v)); }
+
+    /* Finds the strongly connected components (Tarjan, without recursion so
+     * long chains do not overflow the stack). Components are numbered in the
+     * order they must be solved. */
+    void split() {
+      const size_t NONE = (size_t)-1;
+      std::vector<size_t> offsets(nnodes + 1, 0), adjacency(edges.size());
+      std::vector<size_t> order(nnodes, NONE), low(nnodes), stack, calls;
+      std::vector<size_t> cursor(nnodes);
+      std::vector<bool> onStack(nnodes, false);
+      size_t counter = 0, ncomponents = 0;
+
+      for (const std::pair<size_t, size_t> &e : edges) offsets[e.first + 1]++;
+      for (size_t u = 0; u < nnodes; u++) offsets[u+1] += offsets[u];
+      std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+      for (const std::pair<size_t, size_t> &e : edges)
+        adjacency[fill[e.first]++] = e.second;
+
+      component.assign(nnodes, NONE);
+      for (size_t root = 0; root < nnodes; root++) {
+        if (order[root] != NONE) continue;
+        calls.push_back(root);
+        order[root] = low[root] = counter++;
+        cursor[root] = offsets[root];
+        stack.push_back(root); onStack[root] = true;
+
+        while (!calls.empty()) {
+          size_t u = calls.back();
+          if (cursor[u] < offsets[u+1]) {
+            size_t v = adjacency[cursor[u]++];
+            if (order[v] == NONE) {
+              order[v] = low[v] = counter++;
+              cursor[v] = offsets[v];
+              stack.push_back(v); onStack[v] = true;
+              calls.push_back(v);
+            } else if (onStack[v] && order[v] < low[u]) {
+              low[u] = order[v];
+            }
+            continue;
+          }
+
+          calls.pop_back();
+          if (!calls.empty() && low[u] < low[calls.back()])
+            low[calls.back()] = low[u];
+          if (low[u] == order[u]) {
+            size_t v;
+            do {
+              v = stack.back(); stack.pop_back(); onStack[v] = false;
+              component[v] = ncomponents;
+            } while (v != u);
+            ncomponents++;
+          }
+        }
+      }
+
+      // Members of each component
+      memberOffsets.assign(ncomponents + 1, 0);
+      for (size_t u = 0; u < nnodes; u++) memberOffsets[component[u] + 1]++;
+      for (size_t c = 0; c < ncomponents; c++)
+        memberOffsets[c+1] += memberOffsets[c];
+      members.resize(nnodes);
+      fill.assign(memberOffsets.begin(), memberOffsets.end() - 1);
+      for (size_t u = 0; u < nnodes; u++) members[fill[component[u]]++] = u;
+
+      // Edges between components, without repetitions
+      std::vector<std::pair<size_t, size_t>> links;
+      for (const std::pair<size_t, size_t> &e : edges)
+        if (component[e.first] != component[e.second])
+          links.push_back(std::make_pair(component[e.second],
+            component[e.first]));
+      std::sort(links.begin(), links.end());
+      links.erase(std::unique(links.begin(), links.end()), links.end());
+
+      dependentOffsets.assign(ncomponents + 1, 0);
+      ndependencies.assign(ncomponents, 0);
+      dependents.resize(links.size());
+      for (const std::pair<size_t, size_t> &l : links) {
+        dependentOffsets[l.first + 1]++;
+        ndependencies[l.second]++;
+      }
+      for (size_t c = 0; c < ncomponents; c++)
+        dependentOffsets[c+1] += dependentOffsets[c];
+      for (size_t i = 0; i < links.size(); i++) dependents[i] = links[i].second;
+    }
+
+    size_t components() const { return ndependencies.size(); }
+
+    Span<size_t> membersOf(size_t c) const {
+      return Span<size_t>(members.data() + memberOffsets[c],
+        members.data() + memberOffsets[c+1]);
+    }
+
+    /* Calls fn(component) for every component after the components it
+     * needs. With a pool, independent components run at the same time. Each
+     * call must only write the values of the nodes of its component, so the
+     * results do not need locks. */
+    template <typename Fn>
+    void solve(Fn fn, ThreadPool *pool) const {
+      if (pool == NULL) {
+        for (size_t c = 0; c < components(); c++) fn(c);
+        return;
+      }
+
+      std::unique_ptr<std::atomic<size_t>[]> waiting(
+        new std::atomic<size_t>[components()]);
+      for (size_t c = 0; c < components(); c++) waiting[c] = ndependencies[c];
+
+      std::function<void(size_t)> run = [&](size_t c) {
+        fn(c);
+        for (size_t i = dependentOffsets[c]; i < dependentOffsets[c+1]; i++)
+          if (--waiting[dependents[i]] == 0) {
+            size_t d = dependents[i];
+            pool->submit([&run, d] { run(d); });
+          }
+      };
+
+      for (size_t c = 0; c < components(); c++)
+        if (ndependencies[c] == 0) pool->submit([&run, c] { run(c); });
+      pool->wait();
+    }
+};
+
+#endif
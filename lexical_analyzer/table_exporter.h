@@ -0,0 +1,236 @@
+#ifndef table_exporter
+#define table_exporter
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "lexical_analyzer.h"
+
+#define WRITER_BUFFER_LEN 65536
+
+enum class TableFormat { HTML, CSV, JSON, MARKDOWN };
+
+/* Writes to a file through a big buffer so every cell does not cost a call
+ * to the C library. It can also append to a string instead of a file. */
+class BufferedWriter {
+  private:
+    FILE *file;
+    std::string *text;
+    std::vector<char> buffer;
+    size_t used;
+
+    void put(const char *str, size_t len) {
+      if (text != NULL) text->append(str, len);
+      else fwrite(str, 1, len, file);
+    }
+
+  public:
+    BufferedWriter(FILE *file_) : file(file_), buffer(WRITER_BUFFER_LEN) {
+      text = NULL;
+      used = 0;
+    }
+
+    BufferedWriter(std::string &text_) : file(NULL), buffer(WRITER_BUFFER_LEN) {
+      text = &text_;
+      used = 0;
+    }
+
+    ~BufferedWriter() { flush(); }
+
+    void flush() {
+      if (used > 0) put(buffer.data(), used);
+      used = 0;
+    }
+
+    void write(const char *str, size_t len) {
+      if (used + len > buffer.size()) {
+        flush();
+        if (len > buffer.size()) { put(str, len); return; }
+      }
+      memcpy(buffer.data() + used, str, len);
+      used += len;
+    }
+
+    void write(const char *str) { write(str, strlen(str)); }
+
+    void write(const std::string &str) { write(str.data(), str.size()); }
+};
+
+/* Exports the LL table of an analyzer. Every production is formatted and
+ * escaped once and the rows are written straight from the analyzer, so the
+ * cost of an export is the size of the output. */
+class TableExporter {
+  private:
+    TableFormat format;
+
+    /* Returns the text escaped for the format */
+    std::string escape(const std::string &str) const {
+      std::string out;
+      switch (format) {
+        case TableFormat::HTML:
+          for (const char c : str) {
+            if (c == '&') out.append("&amp;");
+            else if (c == '<') out.append("&lt;");
+            else if (c == '>') out.append("&gt;");
+            else if (c == '"') out.append("&quot;");
+            else out.push_back(c);
+          }
+          break;
+        case TableFormat::CSV:
+          if (str.find_first_of(",\"\n") == std::string::npos) return str;
+          out.push_back('"');
+          for (const char c : str) {
+            if (c == '"') out.push_back('"');
+            out.push_back(c);
+          }
+          out.push_back('"');
+          break;
+        case TableFormat::JSON:
+          out.push_back('"');
+          for (const char c : str) {
+            if (c == '"' || c == '\\') { out.push_back('\\'); out.push_back(c); }
+            else if ((unsigned char)c < 0x20) {
+              char code[8];
+              snprintf(code, sizeof(code), "\\u%04x", c);
+              out.append(code);
+            } else out.push_back(c);
+          }
+          out.push_back('"');
+          break;
+        case TableFormat::MARKDOWN:
+          for (const char c : str) {
+            if (c == '|' || c == '\\' || c == '*' || c == '_' || c == '`')
+              out.push_back('\\');
+            out.push_back(c);
+          }
+          break;
+      }
+      return out;
+    }
+
+  public:
+    TableExporter(TableFormat format_) : format(format_) {}
+
+    /* Reads the format from its name (html, csv, json, md). Returns false if
+     * the name is unknown. */
+    static bool parseFormat(const std::string &name, TableFormat &format) {
+      if (name == "html") format = TableFormat::HTML;
+      else if (name == "csv") format = TableFormat::CSV;
+      else if (name == "json") format = TableFormat::JSON;
+      else if (name == "md" || name == "markdown") format=TableFormat::MARKDOWN;
+      else return false;
+      return true;
+    }
+
+    /* Writes the LL table of the analyzer. It must be LL. */
+    void write(const LexicalAnalyzer &analyzer, BufferedWriter &out) const {
+      const CountedVector<std::string> &terms = analyzer.termNames;
+      const size_t nterms = (terms.empty())? 0 : terms.size()-1; // Without "$"
+      std::vector<std::string> termText(nterms), prodText(analyzer.prods.size());
+      std::vector<bool> formatted(analyzer.prods.size(), false);
+      std::vector<size_t> row(nterms);
+      const size_t NONE = (size_t)-1;
+
+      for (size_t t = 0; t < nterms; t++) termText[t] = escape(terms[t]);
+
+      // Header
+      switch (format) {
+        case TableFormat::HTML:
+          out.write("<table>\n\t<tr>\n\t\t<th>No Terminal</th>\n");
+          for (const std::string &t : termText) {
+            out.write("\t\t<th>"); out.write(t); out.write("</th>\n");
+          }
+          out.write("\t</tr>\n");
+          break;
+        case TableFormat::CSV:
+          out.write("No Terminal");
+          for (const std::string &t : termText) { out.write(","); out.write(t); }
+          out.write("\n");
+          break;
+        case TableFormat::JSON:
+          out.write("{\"terminals\": [");
+          for (size_t t = 0; t < nterms; t++) {
+            if (t > 0) out.write(", ");
+            out.write(termText[t]);
+          }
+          out.write("], \"table\": {");
+          break;
+        case TableFormat::MARKDOWN:
+          out.write("| No Terminal |");
+          for (const std::string &t : termText) {
+            out.write(" "); out.write(t); out.write(" |");
+          }
+          out.write("\n|---|");
+          for (size_t t = 0; t < nterms; t++) out.write("---|");
+          out.write("\n");
+          break;
+      }
+
+      // Rows
+      for (size_t v = 0; v < analyzer.vars.size(); v++) {
+        const Variable &var = analyzer.vars[v];
+        std::string name = escape(var.name);
+
+        std::fill(row.begin(), row.end(), NONE);
+        for (size_t t = 0; t < nterms && analyzer.isLL; t++) {
+          int p = analyzer.llTable.get(v, t);
+          if (p < 0) continue;
+          row[t] = p;
+          if (!formatted[p]) {
+            prodText[p] = escape(analyzer.prods[p].toString());
+            formatted[p] = true;
+          }
+        }
+
+        switch (format) {
+          case TableFormat::HTML:
+            out.write("\t<tr>\n\t\t<td>"); out.write(name); out.write("</td>\n");
+            for (size_t t = 0; t < nterms; t++) {
+              out.write("\t\t<td>");
+              if (row[t] != NONE) out.write(prodText[row[t]]);
+              out.write("</td>\n");
+            }
+            out.write("\t</tr>\n");
+            break;
+          case TableFormat::CSV:
+            out.write(name);
+            for (size_t t = 0; t < nterms; t++) {
+              out.write(",");
+              if (row[t] != NONE) out.write(prodText[row[t]]);
+            }
+            out.write("\n");
+            break;
+          case TableFormat::JSON: {
+            bool first = true;
+            if (v > 0) out.write(", ");
+            out.write(name); out.write(": {");
+            for (size_t t = 0; t < nterms; t++) {
+              if (row[t] == NONE) continue;
+              if (!first) out.write(", ");
+              out.write(termText[t]); out.write(": "); out.write(prodText[row[t]]);
+              first = false;
+            }
+            out.write("}");
+            break;
+          }
+          case TableFormat::MARKDOWN:
+            out.write("| "); out.write(name); out.write(" |");
+            for (size_t t = 0; t < nterms; t++) {
+              out.write(" ");
+              if (row[t] != NONE) out.write(prodText[row[t]]);
+              out.write(" |");
+            }
+            out.write("\n");
+            break;
+        }
+      }
+
+      // Footer
+      if (format == TableFormat::HTML) out.write("</table>\n");
+      else if (format == TableFormat::JSON) out.write("}}\n");
+    }
+};
+
+#endif
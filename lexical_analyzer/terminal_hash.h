@@ -0,0 +1,148 @@
+#ifndef terminal_hash
+#define terminal_hash
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "memory_account.h"
+#include "production_set.h"
+
+#define HASH_KEYS_PER_BUCKET 2
+#define HASH_MAX_SEED 1000000
+#define HASH_MAX_SALTS 64
+
+/* Minimal perfect hash over the terminals of a grammar (hash and displace).
+ * Every terminal falls in a bucket and every bucket has a seed chosen so its
+ * terminals land in free slots, so n terminals use exactly n slots. Looking a
+ * word up costs one hash, two array reads and one compare with the only
+ * terminal it can be, for known and unknown words alike. */
+class TerminalHash {
+  private:
+    CountedVector<uint32_t> seeds; // Seed of each bucket
+    CountedVector<int> ids;        // Terminal id of each slot
+    CountedVector<size_t> offsets; // Slot s is text[offsets[s]..[s+1])
+    CountedVector<char> text;      // Terminals in slot order
+    uint64_t salt;
+
+    static uint64_t mix(uint64_t x) {
+      x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+      x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+      return x ^ (x >> 31);
+    }
+
+    uint64_t hash(const char *str, size_t len) const {
+      uint64_t h = 1469598103934665603ULL ^ salt;
+      for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)str[i];
+        h *= 1099511628211ULL;
+      }
+      return mix(h);
+    }
+
+    /* Maps 32 bits to 0..n-1 without a division */
+    static size_t reduce(uint32_t x, size_t n) {
+      return ((uint64_t)x * n) >> 32;
+    }
+
+    size_t bucketOf(uint64_t h) const { return reduce(h >> 32, seeds.size()); }
+
+    size_t slotOf(uint64_t h, uint32_t seed) const {
+      return reduce((uint32_t)mix(h + seed), ids.size());
+    }
+
+    /* Tries to place every bucket with the current salt */
+    bool place(Span<std::string> names) {
+      std::vector<std::vector<size_t>> buckets(seeds.size());
+      std::vector<uint64_t> hashes(names.size());
+      std::vector<size_t> order(seeds.size()), slots;
+      std::vector<bool> used(ids.size(), false);
+
+      for (size_t t = 0; t < names.size(); t++) {
+        hashes[t] = hash(names[t].data(), names[t].size());
+        buckets[bucketOf(hashes[t])].push_back(t);
+      }
+      for (size_t b = 0; b < order.size(); b++) order[b] = b;
+      std::sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+        return buckets[x].size() > buckets[y].size();
+      });
+
+      // Biggest buckets first, while there are many free slots
+      for (const size_t b : order) {
+        uint32_t seed;
+        for (seed = 0; seed < HASH_MAX_SEED; seed++) {
+          bool fits = true;
+          slots.clear();
+          for (size_t i = 0; i < buckets[b].size() && fits; i++) {
+            size_t s = slotOf(hashes[buckets[b][i]], seed);
+            fits = !used[s] && std::find(slots.begin(), slots.end(), s) ==
+              slots.end();
+            slots.push_back(s);
+          }
+          if (fits) break;
+        }
+        if (seed == HASH_MAX_SEED) return false;
+        seeds[b] = seed;
+        for (size_t i = 0; i < buckets[b].size(); i++) {
+          used[slots[i]] = true;
+          ids[slots[i]] = buckets[b][i];
+        }
+      }
+      return true;
+    }
+
+  public:
+    /* The arrays are charged to the account, if there is one */
+    TerminalHash(MemoryAccount *account = NULL) :
+      seeds(CountingAllocator<char>(account, MemoryCategory::SYMBOLS)),
+      ids(seeds.get_allocator()), offsets(seeds.get_allocator()),
+      text(seeds.get_allocator()) {
+      salt = 0;
+    }
+
+    /* Builds the hash for the names, the id of each one is its position.
+     * Returns false, leaving the hash empty, if no salt out of
+     * HASH_MAX_SALTS places them, like when a name repeats. */
+    bool build(Span<std::string> names) {
+      seeds.assign(names.size() / HASH_KEYS_PER_BUCKET + 1, 0);
+      ids.assign(names.size(), -1);
+      for (salt = 0; !names.empty() && !place(names); salt++) {
+        std::fill(ids.begin(), ids.end(), -1);
+        if (salt + 1 == HASH_MAX_SALTS) {
+          ids.clear();
+          offsets.assign(1, 0);
+          text.clear();
+          return false;
+        }
+      }
+
+      offsets.assign(1, 0);
+      text.clear();
+      for (size_t s = 0; s < ids.size(); s++) {
+        const std::string &name = names[ids[s]];
+        text.insert(text.end(), name.begin(), name.end());
+        offsets.push_back(text.size());
+      }
+      return true;
+    }
+
+    /* Returns the id of the word or -1 if it is not one of the names */
+    int find(const char *str, size_t len) const {
+      if (ids.empty()) return -1;
+      uint64_t h = hash(str, len);
+      size_t s = slotOf(h, seeds[bucketOf(h)]);
+      if (offsets[s+1] - offsets[s] != len) return -1;
+      if (len > 0 && memcmp(text.data() + offsets[s], str, len) != 0) return -1;
+      return ids[s];
+    }
+
+    int find(const std::string &word) const {
+      return find(word.data(), word.size());
+    }
+
+    size_t size() const { return ids.size(); }
+};
+
+#endif
@@ -1,7 +1,17 @@
+#include <atomic>
 #include <iterator>
 #include <list>
+#include <random>
 #include <string>
+#include <unistd.h>
+#include "batch_analysis.h"
+#include "grammar_cache.h"
+#include "grammar_versions.h"
+#include "incremental_parser.h"
 #include "lexical_analyzer.h"
+#include "push_parser.h"
+#include "sparse_table.h"
+#include "table_exporter.h"
 
 #define DEBUG 1
 
@@ -9,6 +19,26 @@ void print_correct() { fprintf(stdout, "\033[1;32mCORRECT\033[0m\n"); }
 
 void print_incorrect() { fprintf(stdout, "\033[1;31mINCORRECT\033[0m\n"); }
 
+/* Semantic actions that translate expressions to postfix notation. The
+ * operator of "X -> + E" and "Y -> * T" goes after its operands. */
+struct PostfixActions {
+  std::string shift(const std::string &terminal) {
+    return (terminal == "(" || terminal == ")")? "" : terminal;
+  }
+
+  std::string reduce(size_t, std::string *values, size_t n) {
+    std::string str, op;
+    for (size_t i = 0; i < n; i++) {
+      if (values[i] == "+" || values[i] == "*") { op = values[i]; continue; }
+      if (values[i].empty()) continue;
+      if (!str.empty()) str.append(" ");
+      str.append(values[i]);
+    }
+    if (!op.empty()) { str.append(" "); str.append(op); }
+    return str;
+  }
+};
+
 void compare_lists(std::list<std::string> list1, std::list<std::string> list2) {
   std::list<std::string> intersection, subs1, subs2;
   list1.sort();
@@ -104,6 +134,46 @@ int main(int argc, char *argv[]) {
   // LL? (Yes)
   fprintf(stdout, "Test LL(1): ");
   (analyzer.is_ll())? print_correct() : print_incorrect();
+
+  // Cells of the LL table, FOLLOW terminals only through EPSILON
+  fprintf(stdout, "Test LL table cells: ");
+  (analyzer.getProd("E", "(") == "E -> T EPrime" &&
+    analyzer.getProd("EPrime", "+") == "EPrime -> + T EPrime" &&
+    analyzer.getProd("EPrime", "''") == "EPrime -> ''" &&
+    analyzer.getProd("EPrime", ")") == "" &&
+    analyzer.getProd("F", "+") == "" && analyzer.getProd("G", "id") == "")?
+    print_correct() : print_incorrect();
+
+  // '' is in FIRST(EPrime) but it is not a word of the strings
+  fprintf(stdout, "Test string 'id \'\'': ");
+  (!analyzer.validStr("id ''") && !analyzer.validStr("id + ''") &&
+    analyzer.validStr("id + id"))? print_correct() : print_incorrect();
+
+  // Terminal hash
+  std::list<std::string> terminals = analyzer.getTerminals();
+  std::vector<std::string> names(terminals.begin(), terminals.end());
+  TerminalHash hash;
+  bool found = true;
+  found = hash.build(Span<std::string>(names.data(),
+    names.data() + names.size()));
+  for (size_t t = 0; t < names.size(); t++)
+    found = found && hash.find(names[t]) == (int)t;
+  fprintf(stdout, "Test terminal hash: ");
+  (found && hash.find("E") == -1 && hash.find("") == -1 && hash.find("idd") == -1)?
+    print_correct() : print_incorrect();
+
+  // Repeated names can not be placed, build gives up instead of looping
+  names.push_back(names.front());
+  fprintf(stdout, "Test terminal hash with repeated names: ");
+  (!hash.build(Span<std::string>(names.data(), names.data() + names.size())) &&
+    hash.find(names.front()) == -1)? print_correct() : print_incorrect();
+
+  // "$" marks the end of the input and is not a terminal
+  LexicalAnalyzer endMarker;
+  fprintf(stdout, "Test end marker as a terminal: ");
+  (!endMarker.parse("S -> a $ b") && endMarker.parse("S -> a b") &&
+    endMarker.validStr("a b") && !endMarker.validStr("a $ b"))?
+    print_correct() : print_incorrect();
   fprintf(stdout, "\n");
 // ================================= TEST 01 =================================
 
@@ -145,6 +215,17 @@ int main(int argc, char *argv[]) {
   // LL? (No)
   fprintf(stdout, "Test LL(1): ");
   (!analyzer.is_ll())? print_correct() : print_incorrect();
+
+  // Operator precedence? (Yes)
+  fprintf(stdout, "Test operator precedence: ");
+  (analyzer.is_operator_precedence())? print_correct() : print_incorrect();
+
+  // Accept string (operator precedence)
+  fprintf(stdout, "Test string 'id + id * ( id + id )': ");
+  (analyzer.validStr("id + id * ( id + id )"))? print_correct() : print_incorrect();
+
+  fprintf(stdout, "Test string 'id + * id': ");
+  (!analyzer.validStr("id + * id"))? print_correct() : print_incorrect();
   fprintf(stdout, "\n");
 // ================================= TEST 02 =================================
 
@@ -190,6 +271,17 @@ int main(int argc, char *argv[]) {
   // LL? (No)
   fprintf(stdout, "Test LL(1): ");
   (!analyzer.is_ll())? print_correct() : print_incorrect();
+
+  // Regular? (Yes, right linear)
+  fprintf(stdout, "Test regular: ");
+  (analyzer.is_regular())? print_correct() : print_incorrect();
+
+  // Accept string (DFA)
+  fprintf(stdout, "Test string 'a b a a b b': ");
+  (analyzer.validStr("a b a a b b"))? print_correct() : print_incorrect();
+
+  fprintf(stdout, "Test string 'a b b a': ");
+  (!analyzer.validStr("a b b a"))? print_correct() : print_incorrect();
   fprintf(stdout, "\n");
 // ================================= TEST 03 =================================
 
@@ -233,6 +325,13 @@ int main(int argc, char *argv[]) {
   // LL? (No)
   fprintf(stdout, "Test LL(1): ");
   (!analyzer.is_ll())? print_correct() : print_incorrect();
+
+  // Accept string (Earley)
+  fprintf(stdout, "Test string 'not ( true or false ) and true': ");
+  (analyzer.validStr("not ( true or false ) and true"))? print_correct() : print_incorrect();
+
+  fprintf(stdout, "Test string '( true or ) false': ");
+  (!analyzer.validStr("( true or ) false"))? print_correct() : print_incorrect();
   fprintf(stdout, "\n");
 // ================================= TEST 04 =================================
 
@@ -274,7 +373,7 @@ int main(int argc, char *argv[]) {
 
   // LL? (No)
   fprintf(stdout, "Test LL(1): ");
-  (analyzer.is_ll())? print_correct() : print_incorrect();
+  (!analyzer.is_ll())? print_correct() : print_incorrect();
   fprintf(stdout, "\n");
 // ================================= TEST 05 =================================
 
@@ -380,9 +479,681 @@ int main(int argc, char *argv[]) {
   fprintf(stdout, "Test string 'int * ( int + int )': ");
   (analyzer.validStr("int * ( int + int )"))? print_correct() : print_incorrect();
 
+  // Translate string
+  PostfixActions postfix;
+  std::string translation;
+  fprintf(stdout, "Test translation 'int * ( int + int )': ");
+  (analyzer.translate("int * ( int + int )", postfix, translation) &&
+    translation == "int int int + *")? print_correct() : print_incorrect();
+
+  fprintf(stdout, "Test translation 'int + ( int': ");
+  (!analyzer.translate("int + ( int", postfix, translation))?
+    print_correct() : print_incorrect();
+
+  // Edit a parsed string
+  IncrementalParser incremental(analyzer, 2);
+  fprintf(stdout, "Test edit 'int * ( int + int )' to 'int * ( int + ( int': ");
+  (incremental.parse("int * ( int + int )") &&
+    !incremental.edit(5, 2, "( int"))? print_correct() : print_incorrect();
+
+  fprintf(stdout, "Test edit back to 'int * ( int + ( int ) )': ");
+  (incremental.edit(7, 0, ") )"))? print_correct() : print_incorrect();
+
+  // An edit in the middle of a long string reads up to the next snapshot
+  // where the stack is the same, not the rest of the string
+  std::string sum = "int";
+  for (int i = 0; i < 2000; i++) sum.append(" + int");
+  IncrementalParser longEdit(analyzer, 16);
+  bool longParsed = longEdit.parse(sum) && longEdit.getWork() == 4002;
+  fprintf(stdout, "Test edit cost: ");
+  (longParsed && longEdit.edit(2000, 1, "( int * int )") &&
+    longEdit.getWork() <= 2 * 16 + 5 && longEdit.size() == 4005 &&
+    !longEdit.edit(3001, 1, "int") && longEdit.getErrorPos() == 3001 &&
+    longEdit.getWork() <= 16 + 1)? print_correct() : print_incorrect();
+
+  // Push words one at a time
+  PushParser pusher(analyzer);
+  fprintf(stdout, "Test push 'int * ( int + int )': ");
+  (pusher.feed({"int", "*", "(", "int"}) == ParseState::NEED_MORE &&
+    pusher.feed({"+", "int", ")"}) == ParseState::NEED_MORE &&
+    pusher.finish() == ParseState::ACCEPT)? print_correct() : print_incorrect();
+
+  pusher.reset();
+  fprintf(stdout, "Test push 'int + ( int': ");
+  (pusher.feed({"int", "+", "(", "int"}) == ParseState::NEED_MORE &&
+    pusher.finish() == ParseState::REJECT)? print_correct() : print_incorrect();
+
+  pusher.reset();
+  fprintf(stdout, "Test push 'int + )': ");
+  (pusher.feed({"int", "+", ")"}) == ParseState::REJECT &&
+    pusher.getCount() == 2)? print_correct() : print_incorrect();
+
   fprintf(stdout, "\n");
 // ================================= TEST 06 =================================
 
+  analyzer.clear();
+
+// ================================= TEST 08 =================================
+  fprintf(stdout, "===================== TEST 08 =====================\n");
+  analyzer.parse({
+    "S -> A b",
+    "S -> C",
+    "A -> a",
+    "A -> ''",
+    "B -> c",
+    "C -> C d",
+    "D -> S B"
+  }, false);
+  GrammarCleanup cleanup = analyzer.cleanup();
+
+  // Removed symbols
+  fprintf(stdout, "Test unproductive variables: ");
+  compare_lists(cleanup.unproductive, {"C"});
+  fprintf(stdout, "Test unreachable variables: ");
+  compare_lists(cleanup.unreachable, {"B", "D"});
+  fprintf(stdout, "Test nullable variables: ");
+  compare_lists(cleanup.nullable, {"A"});
+  fprintf(stdout, "Test removed terminals: ");
+  compare_lists(cleanup.terminals, {"c", "d"});
+  fprintf(stdout, "Test removed productions: ");
+  compare_lists(cleanup.productions, {"S -> C", "B -> c", "C -> C d",
+    "D -> S B"});
+
+  // Terminals and not terminals
+  fprintf(stdout, "Test synthatic variables: ");
+  compare_lists(analyzer.getVariables(), {"S", "A"});
+  fprintf(stdout, "Test terminals: ");
+  compare_lists(analyzer.getTerminals(), {"a", "b"});
+
+  // LL? (Yes)
+  fprintf(stdout, "Test LL(1): ");
+  (analyzer.is_ll())? print_correct() : print_incorrect();
+
+  // Accept string
+  fprintf(stdout, "Test string 'a b': ");
+  (analyzer.validStr("a b") && analyzer.validStr("b"))?
+    print_correct() : print_incorrect();
+
+  // The start symbol keeps the first production when that one is removed
+  LexicalAnalyzer clean;
+  clean.parse({"S -> C", "A -> a", "S -> A b", "C -> C d"}, false);
+  clean.cleanup();
+  fprintf(stdout, "Test cleanup start symbol: ");
+  (clean.validStr("a b") && !clean.validStr("a"))?
+    print_correct() : print_incorrect();
+
+  // Memory accounting
+  fprintf(stdout, "Test memory report: ");
+  (analyzer.getMemory().getUsed(MemoryCategory::TABLES) > 0 &&
+    analyzer.getMemory().getUsed(MemoryCategory::PRODUCTIONS) > 0)?
+    print_correct() : print_incorrect();
+
+  bool exceeded = false;
+  analyzer.setMemoryBudget(analyzer.getMemory().getTotal() / 2);
+  fprintf(stdout, "Test memory budget: ");
+  try { analyzer.parse("A -> a A"); }
+  catch (const std::runtime_error &) { exceeded = true; }
+  (exceeded && analyzer.getProdId("A -> a A") == -1)?
+    print_correct() : print_incorrect();
+  analyzer.setMemoryBudget(0);
+
+  // Sparse LL table, rows of 130 cells with a few exceptions
+  SparseTable sparse;
+  int cells[2][130];
+  bool same = true;
+  sparse.clear(130);
+  for (int c = 0; c < 130; c++) {
+    cells[0][c] = (c == 3 || c == 64 || c == 129)? c : -1;
+    cells[1][c] = (c % 2 == 0)? 7 : 8;
+  }
+  sparse.addRow(cells[0]);
+  sparse.addRow(cells[1]);
+  for (int r = 0; r < 2; r++)
+    for (int c = 0; c < 130; c++)
+      same = same && sparse.get(r, c) == cells[r][c];
+  fprintf(stdout, "Test sparse table: ");
+  (same && sparse.exceptions() == 3 + 65)? print_correct() : print_incorrect();
+  fprintf(stdout, "\n");
+// ================================= TEST 08 =================================
+
+  analyzer.clear();
+
+// ================================= TEST 09 =================================
+  fprintf(stdout, "===================== TEST 09 =====================\n");
+  analyzer.setPrecedence("+", 1);
+  analyzer.setPrecedence("*", 2);
+  analyzer.setPrecedence("^", 3, Associativity::RIGHT);
+  analyzer.parse({
+    "E -> E + E",
+    "E -> E * E",
+    "E -> E ^ E",
+    "E -> ( E )",
+    "E -> id"
+  });
+
+  // LL? (No)
+  fprintf(stdout, "Test LL(1): ");
+  (!analyzer.is_ll())? print_correct() : print_incorrect();
+
+  // Operator precedence? (Yes, with the declared precedence)
+  fprintf(stdout, "Test operator precedence: ");
+  (analyzer.is_operator_precedence())? print_correct() : print_incorrect();
+
+  // Accept string
+  fprintf(stdout, "Test string 'id ^ id ^ id * ( id + id ) + id': ");
+  (analyzer.validStr("id ^ id ^ id * ( id + id ) + id"))?
+    print_correct() : print_incorrect();
+
+  fprintf(stdout, "Test string 'id * ( id + ) id': ");
+  (!analyzer.validStr("id * ( id + ) id"))? print_correct() : print_incorrect();
+
+  // There is no LL table to edit with
+  IncrementalParser notLL(analyzer);
+  fprintf(stdout, "Test edit without LL table: ");
+  (!notLL.parse("id + id * id") && notLL.getErrorPos() == 0 &&
+    !notLL.edit(1, 1, "*") && notLL.getErrorPos() == 0 &&
+    notLL.size() == 5)? print_correct() : print_incorrect();
+  fprintf(stdout, "\n");
+// ================================= TEST 09 =================================
+
+// ================================= TEST 10 =================================
+  fprintf(stdout, "===================== TEST 10 =====================\n");
+  GrammarVersions versions;
+  std::shared_ptr<const GrammarVersion> v1 = versions.add(
+    std::list<std::string>{"S -> a S b", "S -> c"});
+  std::shared_ptr<const GrammarVersion> v2 = versions.add("S -> d");
+
+  // Old version still answers
+  fprintf(stdout, "Test versions 'd': ");
+  (!v1->validStr("d") && v2->validStr("a d b") &&
+    versions.get() == v2)? print_correct() : print_incorrect();
+
+  // Productions shared between versions
+  std::list<std::string> many;
+  for (size_t i = 0; i < VERSION_CHUNK; i++)
+    many.push_back("S -> t" + std::to_string(i));
+  std::shared_ptr<const GrammarVersion> v3 = versions.add(many);
+  fprintf(stdout, "Test shared productions: ");
+  (v3->size() == VERSION_CHUNK + 3 && versions.add("S -> e")->shared(*v3) == 1
+    && versions.remove("S -> e")->getAnalyzer() == v3->getAnalyzer() &&
+    versions.rollback() && versions.rollback())?
+    print_correct() : print_incorrect();
+
+  // Rollback to the version with "S -> d"
+  fprintf(stdout, "Test rollback: ");
+  (versions.rollback() && versions.get() == v2 &&
+    versions.remove("S -> x") == nullptr && versions.add("S1 -> a") == nullptr &&
+    versions.get() == v2)? print_correct() : print_incorrect();
+
+  // An edit at the end of the B chain can not change the A chain
+  GrammarVersions twoChains;
+  std::list<std::string> chainRules{"S -> Aa", "S -> Ba"};
+  std::string chainStr;
+  for (char c = 'a'; c < 't'; c++) {
+    chainRules.push_back(std::string("A") + c + " -> a A" + (char)(c + 1));
+    chainRules.push_back(std::string("B") + c + " -> b B" + (char)(c + 1));
+    chainStr.append("b ");
+  }
+  chainRules.push_back("At -> a");
+  chainRules.push_back("Bt -> b");
+  twoChains.add(chainRules);
+  std::shared_ptr<const GrammarVersion> chained = twoChains.add("Bt -> c");
+  LexicalAnalyzer unchained;
+  bool sameSets = true;
+  unchained.parse(chained->getRules());
+  for (const std::string &var : unchained.getVariables())
+    sameSets = sameSets && chained->getFirst(var) == unchained.getFirst(var)
+      && chained->getFollow(var) == unchained.getFollow(var);
+  fprintf(stdout, "Test sets copied from the last version: ");
+  (chained->getAnalyzer()->getReused() == 20 && sameSets &&
+    chained->validStr(chainStr + "c") && !chained->validStr(chainStr + "a"))?
+    print_correct() : print_incorrect();
+  fprintf(stdout, "\n");
+// ================================= TEST 10 =================================
+
+// ================================= TEST 11 =================================
+  fprintf(stdout, "===================== TEST 11 =====================\n");
+  std::atomic<bool> cancel(true);
+  AnalysisControl control;
+  size_t phases = 0;
+  control.cancel = &cancel;
+  control.progress = [&](AnalysisPhase, size_t done, size_t total) {
+    phases += (done <= total);
+  };
+  analyzer.clear();
+  analyzer.parse({
+    "E -> T X",
+    "X -> + E",
+    "X -> ''",
+    "T -> ( E )",
+    "T -> id"
+  }, false);
+
+  // Cancelled before the first long phase
+  fprintf(stdout, "Test cancelled analysis: ");
+  (analyzer.analyze(control) == AnalysisStatus::CANCELLED &&
+    analyzer.getPhase() == AnalysisPhase::NULLABLE && !analyzer.is_ll())?
+    print_correct() : print_incorrect();
+
+  // Resumed from the phase that was stopped
+  cancel = false;
+  fprintf(stdout, "Test resumed analysis: ");
+  (analyzer.analyze(control) == AnalysisStatus::DONE && phases == 6 &&
+    analyzer.getPhase() == AnalysisPhase::DONE && analyzer.is_ll() &&
+    analyzer.validStr("( id + id ) + id"))? print_correct() : print_incorrect();
+
+  // Deadline that already passed
+  analyzer.parse("T -> num", false);
+  fprintf(stdout, "Test analysis deadline: ");
+  (analyzer.analyze(AnalysisControl(std::chrono::seconds(0))) ==
+    AnalysisStatus::TIMED_OUT && analyzer.getTerminals().size() == 5 &&
+    analyzer.getFirst("T").empty())? print_correct() : print_incorrect();
+  fprintf(stdout, "\n");
+// ================================= TEST 11 =================================
+
+// ================================= TEST 12 =================================
+  fprintf(stdout, "===================== TEST 12 =====================\n");
+  analyzer.clear();
+  analyzer.parse({
+    "λ -> x Λ",
+    "Λ -> ≤ y",
+    "Λ -> → λ"
+  });
+
+  // Symbols and separators outside ASCII
+  fprintf(stdout, "Test UTF-8 symbols: ");
+  (analyzer.is_ll() && analyzer.getFirst("Λ").size() == 2 &&
+    analyzer.validStr("x → x ≤ y") && analyzer.validStr("x\t→ x　≤ y") &&
+    !analyzer.validStr("x → ≤ y"))? print_correct() : print_incorrect();
+
+  // Bytes that are not UTF-8 and rules without elements
+  fprintf(stdout, "Test invalid UTF-8: ");
+  (!analyzer.validStr("x \xff") && !analyzer.validStr("x \xe2\x89") &&
+    !Utf8::valid("\xed\xa0\x80", 3) && Utf8::valid("\xf4\x8f\xbf\xbf", 4) &&
+    !analyzer.parse("A ->"))? print_correct() : print_incorrect();
+  fprintf(stdout, "\n");
+// ================================= TEST 12 =================================
+
+// ================================= TEST 13 =================================
+  fprintf(stdout, "===================== TEST 13 =====================\n");
+  LexicalAnalyzer cached;
+  cached.setResultCache(8, 2);
+  cached.parse({
+    "E -> T X",
+    "X -> + E",
+    "X -> ''",
+    "T -> ( E )",
+    "T -> id"
+  });
+
+  // Repeated strings, also with other spacing, are found in the cache
+  fprintf(stdout, "Test result cache: ");
+  bool repeated = cached.validStr("( id + id )") && !cached.validStr("id +") &&
+    cached.validStr("(  id\t+ id )") && !cached.accepts("id +");
+  (repeated && cached.getResultCache()->getHits() == 2 &&
+    cached.getResultCache()->getMisses() == 2)? print_correct() :
+    print_incorrect();
+
+  // The update drops the results of the old grammar
+  cached.parse("T -> num");
+  fprintf(stdout, "Test result cache update: ");
+  (cached.validStr("( num + id )") && cached.getResultCache()->size() == 1 &&
+    cached.getResultCache()->getHits() == 0)? print_correct() :
+    print_incorrect();
+
+  // Terminals that can follow the words accepted so far
+  StrDiagnosis diagnosis = cached.diagnose("( id + )");
+  fprintf(stdout, "Test expected terminals: ");
+  (!diagnosis.valid && diagnosis.position == 3 &&
+    diagnosis.expected == std::list<std::string>{"(", "id", "num"} &&
+    cached.diagnose("( id").expected ==
+      std::list<std::string>{")", "+"})? print_correct() : print_incorrect();
+  fprintf(stdout, "\n");
+// ================================= TEST 13 =================================
+
+// ================================= TEST 14 =================================
+  fprintf(stdout, "===================== TEST 14 =====================\n");
+  analyzer.clear();
+  analyzer.parse({
+    "goal -> A",
+    "A -> ( A ) B",
+    "A -> two",
+    "two -> a",
+    "two -> b",
+    "B -> x C",
+    "C -> y"
+  });
+  GrammarChains chains = analyzer.collapseChains();
+
+  // goal -> A and A -> two are gone, C is only used by B
+  fprintf(stdout, "Test collapsed chains: ");
+  (chains.units == 2 && chains.inlined == 1 &&
+    chains.removed == std::list<std::string>{"two", "C"} &&
+    analyzer.toString() == "goal -> ( A ) B\ngoal -> a\ngoal -> b\n"
+      "A -> ( A ) B\nA -> a\nA -> b\nB -> x y")? print_correct() :
+    print_incorrect();
+
+  fprintf(stdout, "Test collapsed language: ");
+  (analyzer.is_ll() && analyzer.validStr("( ( a ) x y ) x y") &&
+    !analyzer.validStr("( a ) x"))? print_correct() : print_incorrect();
+
+  // Productions of the original grammar in the order they are derived
+  fprintf(stdout, "Test original productions: ");
+  (analyzer.getOriginalProds(analyzer.getProdId("goal -> a")) ==
+    std::list<std::string>{"goal -> A", "A -> two", "two -> a"} &&
+    analyzer.getOriginalProds(analyzer.getProdId("B -> x y")) ==
+    std::list<std::string>{"B -> x C", "C -> y"})? print_correct() :
+    print_incorrect();
+  fprintf(stdout, "\n");
+// ================================= TEST 14 =================================
+
+// ================================= TEST 15 =================================
+  fprintf(stdout, "===================== TEST 15 =====================\n");
+  LexicalAnalyzer profiled;
+  profiled.parse({
+    "E -> T X",
+    "X -> + E",
+    "X -> ''",
+    "T -> ( E )",
+    "T -> id"
+  });
+  profiled.setProfiling(true);
+  profiled.validStr("id + id");
+  profiled.validStr("( id + ( id ) )");
+  profiled.validStr("id +");
+  ProfileSummary profile = profiled.getProfile()->summary();
+
+  fprintf(stdout, "Test profiled sentences: ");
+  (profile.sentences == 3 && profile.accepted == 2 && profile.tokens == 12 &&
+    profile.maxTokens == 7 && profile.maxDepth > 0)? print_correct() :
+    print_incorrect();
+
+  // Every E, also the one of "id +" that fails, is expanded to T X
+  fprintf(stdout, "Test profiled productions: ");
+  (!profile.productions.empty() && !profile.cells.empty() &&
+    profile.productions[0] == std::make_pair(std::string("E -> T X"),
+      (uint64_t)7) &&
+    profile.cells[0].first == "E, id")? print_correct() : print_incorrect();
+
+  // A new grammar starts a new profile
+  fprintf(stdout, "Test profile of an update: ");
+  profiled.parse("T -> num");
+  profile = profiled.getProfile()->summary();
+  (profile.sentences == 0 && profile.productions.empty() &&
+    profiled.validStr("num") && profiled.accepts("( num )") &&
+    profiled.getProfile()->summary().sentences == 2)? print_correct() :
+    print_incorrect();
+
+  // More profiles than the thread cache holds, used one after the other
+  std::vector<std::unique_ptr<RecognitionProfile>> profiles;
+  bool oneEach = true;
+  for (size_t i = 0; i < PROFILE_THREAD_CACHE + 4; i++)
+    profiles.emplace_back(new RecognitionProfile({"S -> a"}, {"S"},
+      {"a", "$"}));
+  for (size_t round = 0; round < 3; round++)
+    for (const std::unique_ptr<RecognitionProfile> &p : profiles)
+      p->local().sentence(true, 1, 1);
+  for (const std::unique_ptr<RecognitionProfile> &p : profiles)
+    oneEach = oneEach && p->threadCount() == 1 &&
+      p->summary().sentences == 3;
+  fprintf(stdout, "Test profiles over the thread cache: ");
+  (oneEach)? print_correct() : print_incorrect();
+  fprintf(stdout, "\n");
+// ================================= TEST 15 =================================
+
+// ================================= TEST 16 =================================
+  fprintf(stdout, "===================== TEST 16 =====================\n");
+  // Spacing, order and repeated rules after the first one do not matter
+  fprintf(stdout, "Test canonical grammar: ");
+  (canonicalGrammar({"S  ->\ta S", "S -> b", "S -> ''", "S -> b"}) ==
+    "S -> a S\nS -> ''\nS -> b\n" &&
+    canonicalGrammar({"S -> a S", "S -> ''", "S -> b"}) ==
+    canonicalGrammar({"S -> a S", "S -> b", "S -> ''"}) &&
+    canonicalGrammar({"S -> b", "S -> a S", "S -> ''"}) !=
+    canonicalGrammar({"S -> a S", "S -> b", "S -> ''"}))?
+    print_correct() : print_incorrect();
+
+  GrammarCache grammars(2);
+  uint64_t key1, key2, key3, key;
+  bool hit1, hit2, hit3, hit;
+  std::shared_ptr<LexicalAnalyzer> first = grammars.get({"S -> a S",
+    "S -> b"}, key1, hit1);
+  grammars.get({"A -> x"}, key2, hit2);
+  fprintf(stdout, "Test grammar cache hit: ");
+  (!hit1 && !hit2 && grammars.get({"S -> a  S", "S -> b", "S -> b"}, key,
+    hit) == first && hit && key == key1 && first->is_ll())?
+    print_correct() : print_incorrect();
+
+  // The grammar used last is kept, the other one is evicted
+  grammars.get({"B -> y"}, key3, hit3);
+  fprintf(stdout, "Test grammar cache eviction: ");
+  (!hit3 && grammars.size() == 2 && grammars.find(key2) == nullptr &&
+    grammars.find(key1) == first && grammars.find(key3) != nullptr &&
+    grammars.getHits() == 1 && grammars.getMisses() == 3)?
+    print_correct() : print_incorrect();
+  fprintf(stdout, "\n");
+// ================================= TEST 16 =================================
+
+// ================================= TEST 17 =================================
+  fprintf(stdout, "===================== TEST 17 =====================\n");
+  // Random grammars big enough to be solved by the thread pool give the same
+  // sets with one thread and with many
+  const size_t nvars = PARALLEL_MIN_VARS + 44;
+  std::mt19937 random(17);
+  bool parallelSame = true;
+  // Variables are named with letters only
+  auto varName = [](size_t v) {
+    return std::string("V") + (char)('a' + v / 26 % 26) + (char)('a' + v % 26);
+  };
+  for (int g = 0; g < 10; g++) {
+    std::list<std::string> rules;
+    for (size_t v = 0; v < nvars; v++)
+      for (size_t p = 0, n = 1 + random() % 3; p < n; p++) {
+        std::string rule = varName(v) + " ->";
+        size_t len = random() % 4;
+        if (len == 0) rule.append(" ''");
+        for (size_t i = 0; i < len; i++)
+          rule.append(" " + ((random() % 2)? varName(random() % nvars) :
+            "t" + std::to_string(random() % 20)));
+        rules.push_back(rule);
+      }
+
+    LexicalAnalyzer serial, parallel;
+    serial.setThreads(1);
+    parallel.setThreads(8);
+    parallelSame = parallelSame && serial.parse(rules) &&
+      parallel.parse(rules) && serial.getVariables().size() == nvars &&
+      serial.is_ll() == parallel.is_ll();
+    for (const std::string &var : serial.getVariables())
+      parallelSame = parallelSame &&
+        serial.getFirst(var) == parallel.getFirst(var) &&
+        serial.getFollow(var) == parallel.getFollow(var);
+  }
+  fprintf(stdout, "Test parallel FIRST and FOLLOW: ");
+  (parallelSame)? print_correct() : print_incorrect();
+  fprintf(stdout, "\n");
+// ================================= TEST 17 =================================
+
+// ================================= TEST 18 =================================
+  fprintf(stdout, "===================== TEST 18 =====================\n");
+  LexicalAnalyzer exported;
+  exported.parse({
+    "L -> x R",
+    "L -> \" x",
+    "R -> , x R",
+    "R -> ''"
+  });
+  std::string csv, json, html;
+  TableFormat format;
+  {
+    BufferedWriter csvOut(csv), jsonOut(json), htmlOut(html);
+    TableExporter(TableFormat::CSV).write(exported, csvOut);
+    TableExporter(TableFormat::JSON).write(exported, jsonOut);
+    TableExporter(TableFormat::HTML).write(exported, htmlOut);
+  }
+
+  // Terminals and productions with quotes and commas are escaped
+  fprintf(stdout, "Test CSV table: ");
+  (csv == "No Terminal,\"\"\"\",\",\",x\n"
+    "L,\"L -> \"\" x\",,L -> x R\n"
+    "R,,\"R -> , x R\",\n")? print_correct() : print_incorrect();
+
+  fprintf(stdout, "Test JSON table: ");
+  (json == "{\"terminals\": [\"\\\"\", \",\", \"x\"], \"table\": {"
+    "\"L\": {\"\\\"\": \"L -> \\\" x\", \"x\": \"L -> x R\"}, "
+    "\"R\": {\",\": \"R -> , x R\"}}}\n")? print_correct() :
+    print_incorrect();
+
+  fprintf(stdout, "Test HTML table: ");
+  (html.find("<th>&quot;</th>") != std::string::npos &&
+    html.find("<td>L -&gt; &quot; x</td>") != std::string::npos &&
+    TableExporter::parseFormat("md", format) &&
+    format == TableFormat::MARKDOWN && !TableExporter::parseFormat("xml",
+    format))? print_correct() : print_incorrect();
+  fprintf(stdout, "\n");
+// ================================= TEST 18 =================================
+
+// ================================= TEST 19 =================================
+  fprintf(stdout, "===================== TEST 19 =====================\n");
+  LexicalAnalyzer statements;
+  statements.parse({
+    "L -> S L",
+    "L -> ''",
+    "S -> id = E ;",
+    "S -> print ( E ) ;",
+    "S -> if ( E ) S",
+    "S -> { L }",
+    "E -> E + T",
+    "E -> T",
+    "T -> T * F",
+    "T -> F",
+    "F -> ( E )",
+    "F -> id",
+    "F -> num"
+  });
+
+  // E is not LL but it is an operator precedence language inside the rest
+  fprintf(stdout, "Test expression variables: ");
+  (!statements.is_ll() && statements.is_ll_with_expressions() &&
+    statements.getExpressionVariables() == std::list<std::string>{"E"})?
+    print_correct() : print_incorrect();
+
+  fprintf(stdout, "Test statements with expressions: ");
+  (statements.validStr("id = id + num * ( id + num ) ;") &&
+    statements.validStr("if ( id ) { print ( id * id ) ; id = num ; }") &&
+    statements.validStr("") && statements.accepts("print ( ( id ) ) ;") &&
+    !statements.validStr("id = id + ;") &&
+    !statements.validStr("id = id id ;") &&
+    !statements.validStr("print ( id ) id = num ;") &&
+    !statements.accepts("if ( id + ) id = num ;"))?
+    print_correct() : print_incorrect();
+
+  // A '+' after E in the statements could continue the expression
+  LexicalAnalyzer ambiguousEnd;
+  ambiguousEnd.parse({
+    "L -> S L",
+    "L -> ''",
+    "S -> print E + ;",
+    "E -> E + T",
+    "E -> T",
+    "T -> id"
+  });
+  fprintf(stdout, "Test expression followed by an operator: ");
+  (!ambiguousEnd.is_ll_with_expressions() &&
+    ambiguousEnd.getExpressionVariables().empty() &&
+    ambiguousEnd.validStr("print id + id + ; print id + ;") &&
+    !ambiguousEnd.validStr("print id + id ;"))? print_correct() : print_incorrect();
+  fprintf(stdout, "\n");
+// ================================= TEST 19 =================================
+
+// ================================= TEST 20 =================================
+  fprintf(stdout, "===================== TEST 20 =====================\n");
+  char batchDir[] = "/tmp/batch_test_XXXXXX";
+  std::vector<std::string> batchFiles, listed;
+  std::string batchPaths[3], manifestPath, batchJson, manifestJson;
+  const char *batchTexts[3] = {
+    "2 2\nS -> a S\nS -> b\na a b\na\n", // LL, one test passes
+    "2\r\nS -> S a\r\nS -> b\r\n",        // Left recursive, with CRLF
+    "S -> a\n"                              // No number of rules
+  };
+  bool batchOk = mkdtemp(batchDir) != NULL;
+  for (size_t i = 0; i < 3 && batchOk; i++) {
+    batchPaths[i] = std::string(batchDir) + "/" + (char)('c' - i) + ".txt";
+    FILE *file = fopen(batchPaths[i].c_str(), "w");
+    batchOk = file != NULL && fputs(batchTexts[i], file) >= 0;
+    if (file != NULL) fclose(file);
+  }
+  manifestPath = std::string(batchDir) + ".list";
+  if (batchOk) {
+    FILE *file = fopen(manifestPath.c_str(), "w");
+    batchOk = file != NULL && fprintf(file, "%s\n\n%s\n%s/none.txt\n",
+      batchPaths[0].c_str(), batchPaths[2].c_str(), batchDir) > 0;
+    if (file != NULL) fclose(file);
+  }
+
+  // A directory is read in name order, results keep the order of the files
+  if (batchOk && listGrammarFiles(batchDir, batchFiles)) {
+    BufferedWriter out(batchJson);
+    analyzeGrammarFiles(batchFiles, 3, out);
+  }
+  size_t posA = batchJson.find(jsonString(batchPaths[2]));
+  size_t posB = batchJson.find(jsonString(batchPaths[1]));
+  size_t posC = batchJson.find(jsonString(batchPaths[0]));
+  fprintf(stdout, "Test batch files in order: ");
+  (batchFiles.size() == 3 && batchJson.find("{\"files\": 3, ") == 0 &&
+    posA != std::string::npos && posA < posB && posB < posC &&
+    posC != std::string::npos)? print_correct() : print_incorrect();
+
+  fprintf(stdout, "Test batch results: ");
+  (batchJson.find(jsonString(batchPaths[2]) +
+    ", \"error\": \"Missing the number of rules\"}") != std::string::npos &&
+    batchJson.find(jsonString(batchPaths[1]) + ", \"rules\": 2, "
+    "\"ll\": false, \"regular\": true, \"variables\": [{\"name\": \"S\", "
+    "\"first\": [\"b\"], \"follow\": [\"$\", \"a\"]}], \"table\": null, "
+    "\"tests\": [], \"ms\": ") != std::string::npos &&
+    batchJson.find(jsonString(batchPaths[0]) + ", \"rules\": 2, "
+    "\"ll\": true, \"regular\": true") != std::string::npos &&
+    batchJson.find("\"table\": {\"terminals\": [\"a\", \"b\"], \"table\": "
+    "{\"S\": {\"a\": \"S -> a S\", \"b\": \"S -> b\"}}}, "
+    "\"tests\": [true, false]") != std::string::npos &&
+    batchJson.compare(batchJson.size() - 4, 4, "\n]}\n") == 0)?
+    print_correct() : print_incorrect();
+
+  // A manifest keeps its order, skips empty lines and reports missing files
+  if (batchOk && listGrammarFiles(manifestPath, listed)) {
+    BufferedWriter out(manifestJson);
+    analyzeGrammarFiles(listed, 2, out);
+  }
+  fprintf(stdout, "Test batch manifest: ");
+  (listed.size() == 3 && listed[0] == batchPaths[0] &&
+    listed[1] == batchPaths[2] &&
+    manifestJson.find(jsonString(batchPaths[0])) <
+    manifestJson.find(jsonString(batchPaths[2])) &&
+    manifestJson.find("none.txt\", \"error\": \"Could not open the file\"}")
+    != std::string::npos && !listGrammarFiles(manifestPath + ".none", listed))?
+    print_correct() : print_incorrect();
+
+  // The tail of a rule too long for a line is not read as the next rule
+  std::string longPath = std::string(batchDir) + ".long", longResult;
+  FILE *longFile = fopen(longPath.c_str(), "w");
+  if (longFile != NULL) {
+    fprintf(longFile, "2 1\nS -> %s\nS -> b\nb\n",
+      std::string(BATCH_MAX_LINE_LEN, 'a').c_str());
+    fclose(longFile);
+    longResult = analyzeGrammarFile(longPath);
+  }
+  fprintf(stdout, "Test batch line too long: ");
+  (longResult == "{\"file\": " + jsonString(longPath) + ", \"error\": "
+    "\"Line longer than " + std::to_string(BATCH_MAX_LINE_LEN - 1) +
+    " bytes\"}")? print_correct() : print_incorrect();
+
+  for (const std::string &path : batchPaths) unlink(path.c_str());
+  unlink(manifestPath.c_str());
+  unlink(longPath.c_str());
+  rmdir(batchDir);
+  fprintf(stdout, "\n");
+// ================================= TEST 20 =================================
+
   if (log != NULL) fclose(log);
   return 0;
 }
@@ -0,0 +1,137 @@
+#ifndef thread_pool
+#define thread_pool
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Pool of threads where every worker has its own queue of tasks. A worker
+ * takes the newest task of its queue and, when it runs out of work, steals
+ * the oldest task of another worker. Tasks submitted by a worker go to its
+ * own queue, so dependent tasks tend to stay in the same thread. */
+class ThreadPool {
+  private:
+    struct Queue {
+      std::mutex lock;
+      std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::mutex lock;
+    std::condition_variable available, finished;
+    std::atomic<size_t> queued;  // Tasks waiting in a queue
+    std::atomic<size_t> pending; // Tasks submitted and not finished
+    std::atomic<size_t> next;    // Queue for tasks submitted from outside
+    bool stopping;
+
+    /* Index of the worker running in this thread and the pool it belongs to */
+    static int & workerIndex() { thread_local int index = -1; return index; }
+
+    static ThreadPool *& workerPool() {
+      thread_local ThreadPool *pool = NULL;
+      return pool;
+    }
+
+    bool take(size_t self, std::function<void()> &task) {
+      // Newest task of the own queue
+      {
+        std::lock_guard<std::mutex> guard(queues[self]->lock);
+        if (!queues[self]->tasks.empty()) {
+          task = std::move(queues[self]->tasks.back());
+          queues[self]->tasks.pop_back();
+          queued--;
+          return true;
+        }
+      }
+      // Oldest task of another queue
+      for (size_t i = 1; i < queues.size(); i++) {
+        Queue &victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+          task = std::move(victim.tasks.front());
+          victim.tasks.pop_front();
+          queued--;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void work(size_t self) {
+      std::function<void()> task;
+      workerIndex() = self;
+      workerPool() = this;
+
+      while (true) {
+        if (take(self, task)) {
+          task();
+          task = nullptr;
+          if (--pending == 0) {
+            std::lock_guard<std::mutex> guard(lock);
+            finished.notify_all();
+          }
+          continue;
+        }
+        std::unique_lock<std::mutex> guard(lock);
+        available.wait(guard, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+      }
+    }
+
+  public:
+    ThreadPool(size_t nthreads) : queued(0), pending(0), next(0) {
+      stopping = false;
+      if (nthreads == 0) nthreads = 1;
+      for (size_t i = 0; i < nthreads; i++)
+        queues.push_back(std::unique_ptr<Queue>(new Queue()));
+      for (size_t i = 0; i < nthreads; i++)
+        workers.push_back(std::thread(&ThreadPool::work, this, i));
+    }
+
+    ~ThreadPool() {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+      }
+      available.notify_all();
+      for (std::thread &worker : workers) worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool & operator = (const ThreadPool &) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    /* Queues a task. Tasks can submit more tasks while they run. */
+    void submit(std::function<void()> task) {
+      size_t target = (workerPool() == this)?
+        (size_t)workerIndex() : next++ % queues.size();
+
+      pending++;
+      {
+        std::lock_guard<std::mutex> guard(queues[target]->lock);
+        queues[target]->tasks.push_back(std::move(task));
+      }
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        queued++;
+      }
+      available.notify_one();
+    }
+
+    /* Blocks until every submitted task (and the ones they submit) finished.
+     * It must not be called from a task. */
+    void wait() {
+      std::unique_lock<std::mutex> guard(lock);
+      finished.wait(guard, [this] { return pending == 0; });
+    }
+};
+
+#endif
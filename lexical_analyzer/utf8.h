@@ -0,0 +1,103 @@
+#ifndef utf8
+#define utf8
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* UTF-8 validation and splitting of text in words separated by Unicode
+ * whitespace. ASCII text goes through a fast path: 64 bytes are checked for
+ * a high bit with four SSE2 loads and one movemask. */
+class Utf8 {
+  private:
+    /* Length of the valid sequence that starts at s, 0 if it is not valid */
+    static size_t sequence(const unsigned char *s, size_t n) {
+      const unsigned char c = s[0];
+      unsigned char low = 0x80, high = 0xBF;
+      size_t len;
+
+      if (c < 0x80) return 1;
+      if (c < 0xC2) return 0; // Continuation or overlong
+      if (c < 0xE0) len = 2;
+      else if (c < 0xF0) {
+        len = 3;
+        if (c == 0xE0) low = 0xA0;       // Overlong
+        else if (c == 0xED) high = 0x9F; // Surrogates
+      } else if (c < 0xF5) {
+        len = 4;
+        if (c == 0xF0) low = 0x90;       // Overlong
+        else if (c == 0xF4) high = 0x8F; // Over U+10FFFF
+      } else return 0;
+
+      if (n < len || s[1] < low || s[1] > high) return 0;
+      for (size_t i = 2; i < len; i++)
+        if (s[i] < 0x80 || s[i] > 0xBF) return 0;
+      return len;
+    }
+
+  public:
+    /* Returns if the bytes are valid UTF-8 */
+    static bool valid(const char *str, size_t len) {
+      const unsigned char *s = (const unsigned char *)str;
+      size_t i = 0, n;
+
+      while (i < len) {
+#ifdef __SSE2__
+        // Skip ASCII blocks
+        while (i + 64 <= len) {
+          const __m128i *block = (const __m128i *)(s + i);
+          __m128i any = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128(block), _mm_loadu_si128(block + 1)),
+            _mm_or_si128(_mm_loadu_si128(block+2), _mm_loadu_si128(block+3)));
+          if (_mm_movemask_epi8(any) != 0) break;
+          i += 64;
+        }
+        while (i + 16 <= len &&
+            _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i))) == 0)
+          i += 16;
+#endif
+        // Byte by byte up to the next block
+        for (const size_t stop = i + 16; i < len && i < stop; i += n)
+          if ((n = sequence(s + i, len - i)) == 0) return false;
+      }
+      return true;
+    }
+
+    /* Length of the whitespace character at s (White_Space property of
+     * Unicode), 0 if it is not one. s must be valid UTF-8. */
+    static size_t space(const char *str, size_t n) {
+      const unsigned char *s = (const unsigned char *)str;
+      const unsigned char c = s[0];
+
+      if (c < 0x80) return (c == ' ' || (c >= '\t' && c <= '\r'))? 1 : 0;
+      if (c == 0xC2)                                       // U+0085, U+00A0
+        return (n >= 2 && (s[1] == 0x85 || s[1] == 0xA0))? 2 : 0;
+      if (n < 3) return 0;
+      if (c == 0xE1) return (s[1] == 0x9A && s[2] == 0x80)? 3 : 0; // U+1680
+      if (c == 0xE2 && s[1] == 0x80)          // U+2000..200A, 2028, 2029, 202F
+        return (s[2] <= 0x8A || s[2] == 0xA8 || s[2] == 0xA9 || s[2] == 0xAF)?
+          3 : 0;
+      if (c == 0xE2 && s[1] == 0x81) return (s[2] == 0x9F)? 3 : 0; // U+205F
+      if (c == 0xE3) return (s[1] == 0x80 && s[2] == 0x80)? 3 : 0; // U+3000
+      return 0;
+    }
+
+    /* Calls fn(word, length) for every run of characters that are not
+     * whitespace. Stops and returns false when fn returns false. */
+    template <typename Fn>
+    static bool forEachWord(const char *str, size_t len, Fn fn) {
+      size_t i = 0, start, n;
+
+      while (true) {
+        while (i < len && (n = space(str + i, len - i)) > 0) i += n;
+        if (i >= len) return true;
+        for (start = i; i < len && space(str + i, len - i) == 0; i++);
+        if (!fn(str + start, i - start)) return false;
+      }
+    }
+};
+
+#endif